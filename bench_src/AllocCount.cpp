@@ -0,0 +1,34 @@
+#include "AllocCount.h"
+#include <cstdlib>
+#include <new>
+
+static thread_local AllocCount counts;
+
+AllocCount thread_alloc_count()
+{
+    return counts;
+}
+
+static void* counted_alloc(size_t size, size_t align)
+{
+    counts.allocs++;
+    counts.bytes += size;
+    void* p = align > alignof(std::max_align_t) ? std::aligned_alloc(align, (size + align - 1) / align * align) : std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return counted_alloc(size, 0); }
+void* operator new[](size_t size) { return counted_alloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return counted_alloc(size, size_t(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return counted_alloc(size, size_t(align)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+// Linking AllocCount.cpp replaces the global operator new/delete with
+// versions that count into per-thread totals.
+struct AllocCount {
+    size_t allocs = 0;
+    size_t bytes = 0;
+};
+
+// Totals for the calling thread since it started.
+AllocCount thread_alloc_count();
+
+inline AllocCount operator-(AllocCount a, AllocCount b)
+{
+    return { a.allocs - b.allocs, a.bytes - b.bytes };
+}
@@ -0,0 +1,463 @@
+#include "AllocCount.h"
+#include "BasicTransport.h"
+#include "MyImpl.h"
+#include "Transport.h"
+#include "TransportBackend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+template<class T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchState {
+    size_t iterations;
+    size_t thread_index;
+    size_t bytes = 0;
+};
+
+struct Bench {
+    string name;
+    size_t threads;
+    function<void (BenchState&)> run;
+};
+
+struct Result {
+    size_t iterations;
+    double seconds;
+    AllocCount alloc;
+    size_t bytes;
+};
+
+static Result run_once(const Bench& bench, size_t iterations)
+{
+    vector<AllocCount> allocs(bench.threads);
+    vector<size_t> bytes(bench.threads);
+    atomic<size_t> ready{0};
+    atomic<bool> go{false};
+
+    auto body = [&](size_t t) {
+        BenchState state{ iterations, t };
+        ready.fetch_add(1);
+        while (!go.load(memory_order_acquire))
+            this_thread::yield();
+
+        AllocCount before = thread_alloc_count();
+        bench.run(state);
+        allocs[t] = thread_alloc_count() - before;
+        bytes[t] = state.bytes;
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < bench.threads; t++)
+        workers.emplace_back(body, t);
+    while (ready.load() + 1 < bench.threads)
+        this_thread::yield();
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    body(0);
+    for (auto& w : workers)
+        w.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Result r{ iterations, seconds, {}, 0 };
+    for (size_t t = 0; t < bench.threads; t++) {
+        r.alloc.allocs += allocs[t].allocs;
+        r.alloc.bytes += allocs[t].bytes;
+        r.bytes += bytes[t];
+    }
+    return r;
+}
+
+// Doubles the iteration count (with a jump towards the target) until one
+// run lasts at least min_time.
+static Result run_bench(const Bench& bench, double min_time)
+{
+    size_t n = 1;
+    for (;;) {
+        Result r = run_once(bench, n);
+        if (r.seconds >= min_time || n >= 1000000000)
+            return r;
+        double scale = r.seconds > 0 ? min_time / r.seconds * 1.2 : 100;
+        n = max(n * 2, size_t(n * min(scale, 100.0)));
+    }
+}
+
+static void report(const Bench& bench, const Result& r)
+{
+    double ops = double(r.iterations) * bench.threads;
+    printf("%-32s %12zu %12.1f %10.2f %10.1f %14.0f", bench.name.c_str(), r.iterations, r.seconds * 1e9 / r.iterations,
+           r.alloc.allocs / ops, r.alloc.bytes / ops, ops / r.seconds);
+    if (r.bytes)
+        printf(" %10.1f MB/s", r.bytes / r.seconds / 1e6);
+    printf("\n");
+}
+
+struct MyCallable {
+    size_t data;
+
+    MyCallable(size_t data) : data(data) {}
+
+    Transport::Uuid operator()(size_t arg)
+    {
+        return Transport::make_uuid(data, arg);
+    }
+};
+
+// Large enough to miss std::function's small-buffer storage.
+struct WideCallable {
+    size_t data[6];
+
+    Transport::Uuid operator()(size_t arg)
+    {
+        return Transport::make_uuid(data[0] + data[5], arg);
+    }
+};
+
+// In-process "pure://" backend whose result depends only on the argument,
+// for measuring the result cache.
+struct PureImpl final : public Transport::Impl {
+    std::string process(std::string_view arg) override
+    {
+        string out;
+        process_into(arg, out);
+        return out;
+    }
+
+    void process_into(std::string_view arg, std::string& out) override
+    {
+        out.resize(arg.size());
+        for (size_t i = 0; i < arg.size(); i++)
+            out[i] = char(arg[i] ^ 0x20);
+    }
+
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out) override
+    {
+        out.resize(args.size());
+        for (size_t i = 0; i < args.size(); i++)
+            process_into(args[i], out[i]);
+    }
+
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override { func(0); }
+    void process_with_callable_range(size_t, size_t, FunctionRef<void (size_t, std::span<Transport::Uuid>)>) override {}
+    size_t total_processed() const override { return 0; }
+    unsigned capabilities() const override { return Transport::idempotent; }
+};
+
+static IntrusivePtr<Transport::Impl> pure_factory(TransportError&, string_view, const Transport::Options&, pmr::memory_resource*)
+{
+    return make_intrusive<PureImpl>();
+}
+
+int main(int argc, char *argv[])
+{
+    const char* filter = nullptr;
+    double min_time = 0.2;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--min-time=", 11) == 0)
+            min_time = atof(argv[i] + 11);
+        else
+            filter = argv[i];
+    }
+
+    Transport shared("bench");
+    TransportBackends::add({ "pure", pure_factory, nullptr });
+    Transport::Options sharded_opts;
+    sharded_opts.sharded_counters = true;
+    Transport sharded("bench", sharded_opts);
+    Transport::Options queued_opts;
+    queued_opts.queue_capacity = 1024;
+    Transport queued("bench", queued_opts);
+
+    vector<Bench> benches;
+
+    benches.push_back({ "construct", 1, [](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport t("bench");
+            keep(t);
+        }
+    } });
+
+    benches.push_back({ "construct/failed", 1, [](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport t("fail");
+            keep(t);
+        }
+    } });
+
+    // Only the name and options are kept; the factory never runs.
+    benches.push_back({ "construct/lazy", 1, [](BenchState& st) {
+        Transport::Options opts;
+        opts.lazy = true;
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport t("bench", opts);
+            keep(t);
+        }
+    } });
+
+    benches.push_back({ "construct/pool", 1, [](BenchState& st) {
+        pmr::unsynchronized_pool_resource pool;
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport t("bench", Transport::Options(), &pool);
+            keep(t);
+        }
+    } });
+
+    benches.push_back({ "construct/arena", 1, [](BenchState& st) {
+        char buf[4096];
+        pmr::monotonic_buffer_resource arena(buf, sizeof(buf));
+        for (size_t i = 0; i < st.iterations; i++) {
+            {
+                Transport t("bench", Transport::Options(), &arena);
+                pmr::string out(&arena);
+                t.process_into("x", out);
+                keep(out);
+            }
+            arena.release();
+        }
+    } });
+
+    benches.push_back({ "copy", 1, [&](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport copy = shared;
+            keep(copy);
+        }
+    } });
+
+    benches.push_back({ "move", 1, [&](BenchState& st) {
+        Transport a = shared, b = shared;
+        for (size_t i = 0; i < st.iterations; i++) {
+            b = move(a);
+            a = move(b);
+            keep(a);
+        }
+    } });
+
+    benches.push_back({ "borrow", 1, [&](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            TransportRef ref = shared.borrow();
+            keep(ref);
+        }
+    } });
+
+    Transport::Options confined_opts;
+    confined_opts.thread_confined = true;
+    Transport confined("bench", confined_opts);
+    benches.push_back({ "copy/thread_confined", 1, [&](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            Transport copy = confined;
+            keep(copy);
+        }
+    } });
+
+    for (size_t size : { 1, 16, 256, 4096 }) {
+        string arg(size, 'a');
+        benches.push_back({ "process/" + to_string(size), 1, [&, arg](BenchState& st) {
+            for (size_t i = 0; i < st.iterations; i++)
+                keep(shared.process(arg));
+            st.bytes = st.iterations * arg.size();
+        } });
+        // A pipeline stage: each result's buffer carries the next argument.
+        benches.push_back({ "process/owned/" + to_string(size), 1, [&, arg](BenchState& st) {
+            string payload = arg;
+            for (size_t i = 0; i < st.iterations; i++) {
+                payload = shared.process(move(payload));
+                keep(payload);
+                payload.resize(arg.size());
+            }
+            st.bytes = st.iterations * arg.size();
+        } });
+        benches.push_back({ "process_into/" + to_string(size), 1, [&, arg](BenchState& st) {
+            string out;
+            for (size_t i = 0; i < st.iterations; i++) {
+                shared.process_into(arg, out);
+                keep(out);
+            }
+            st.bytes = st.iterations * arg.size();
+        } });
+    }
+
+    benches.push_back({ "process_fragments/3", 1, [&](BenchState& st) {
+        string header(16, 'h'), body(256, 'b'), trailer(16, 't');
+        string_view in[] = { header, body, trailer };
+        TransportFragments out;
+        for (size_t i = 0; i < st.iterations; i++) {
+            shared.process_fragments(in, out);
+            keep(out.parts().data());
+        }
+        st.bytes = st.iterations * (header.size() + body.size() + trailer.size());
+    } });
+
+    // 1 MiB argument fed in 16 KiB chunks; the output is read after each one.
+    benches.push_back({ "stream/1M", 1, [&](BenchState& st) {
+        string chunk(16384, 'a');
+        vector<char> buf(chunk.size() + 64);
+        for (size_t i = 0; i < st.iterations; i++) {
+            TransportStream stream = shared.open_stream();
+            for (size_t done = 0; done < 1 << 20; done += chunk.size()) {
+                while (!stream.write(chunk))
+                    keep(stream.read(buf));
+                keep(stream.read(buf));
+            }
+            stream.finish();
+            while (!stream.done())
+                keep(stream.read(buf));
+        }
+        st.bytes = st.iterations << 20;
+    } });
+
+    Transport::Options cache_opts;
+    cache_opts.cache_capacity = 1024;
+    Transport pure("pure://bench");
+    Transport cached("pure://bench", cache_opts);
+    for (auto [name, handle] : { pair<const char*, Transport*>{ "pure/256", &pure }, { "pure/256/cached", &cached } }) {
+        benches.push_back({ name, 1, [handle](BenchState& st) {
+            // Eight hot keys.
+            vector<string> args;
+            for (char c = 'a'; c < 'i'; c++)
+                args.push_back(string(256, c));
+            string out;
+            for (size_t i = 0; i < st.iterations; i++) {
+                handle->process_into(args[i % args.size()], out);
+                keep(out);
+            }
+            st.bytes = st.iterations * 256;
+        } });
+    }
+
+    Transport::Options metrics_opts;
+    metrics_opts.metrics = true;
+    Transport metered("bench", metrics_opts);
+    // The cost of the lazy layer once it has opened.
+    Transport::Options lazy_opts;
+    lazy_opts.lazy = true;
+    Transport lazy("bench", lazy_opts);
+    lazy.warm();
+    benches.push_back({ "process_into/16/lazy", 1, [&](BenchState& st) {
+        string arg(16, 'a');
+        string out;
+        for (size_t i = 0; i < st.iterations; i++) {
+            lazy.process_into(arg, out);
+            keep(out);
+        }
+        st.bytes = st.iterations * arg.size();
+    } });
+
+    benches.push_back({ "process_into/16/metrics", 1, [&](BenchState& st) {
+        string arg(16, 'a');
+        string out;
+        for (size_t i = 0; i < st.iterations; i++) {
+            metered.process_into(arg, out);
+            keep(out);
+        }
+        st.bytes = st.iterations * arg.size();
+    } });
+
+    BasicTransport<MyImpl> direct("bench");
+    benches.push_back({ "basic/copy", 1, [&](BenchState& st) {
+        for (size_t i = 0; i < st.iterations; i++) {
+            auto copy = direct;
+            keep(copy);
+        }
+    } });
+    benches.push_back({ "basic/process_into/16", 1, [&](BenchState& st) {
+        string arg(16, 'a');
+        string out;
+        for (size_t i = 0; i < st.iterations; i++) {
+            direct.process_into(arg, out);
+            keep(out);
+        }
+        st.bytes = st.iterations * arg.size();
+    } });
+
+    benches.push_back({ "process_batch/16", 1, [&](BenchState& st) {
+        string_view args[16];
+        fill(begin(args), end(args), "0123456789abcdef");
+        vector<string> out;
+        for (size_t i = 0; i < st.iterations; i++) {
+            shared.process_batch(args, out);
+            keep(out);
+        }
+        st.bytes = st.iterations * 16 * 16;
+    } });
+
+    benches.push_back({ "process_async/64", 1, [&](BenchState& st) {
+        vector<TransportFuture<string>> pending(64);
+        for (size_t i = 0; i < st.iterations; i++) {
+            for (auto& f : pending)
+                f = shared.process_async("x");
+            for (auto& f : pending)
+                keep(f.get());
+        }
+    } });
+
+    benches.push_back({ "callable/lambda", 1, [&](BenchState& st) {
+        size_t base = 7;
+        for (size_t i = 0; i < st.iterations; i++)
+            shared.process_with_callable([&](size_t arg) { return Transport::make_uuid(base, arg); });
+    } });
+
+    benches.push_back({ "callable/MyCallable", 1, [&](BenchState& st) {
+        MyCallable policy(1);
+        for (size_t i = 0; i < st.iterations; i++)
+            shared.process_with_callable(policy);
+    } });
+
+    benches.push_back({ "callable/std::function", 1, [&](BenchState& st) {
+        WideCallable wide{};
+        for (size_t i = 0; i < st.iterations; i++)
+            shared.process_with_callable(function<Transport::Uuid (size_t)>(wide));
+    } });
+
+    benches.push_back({ "callable_range/1024", 1, [&](BenchState& st) {
+        MyCallable policy(1);
+        for (size_t i = 0; i < st.iterations; i++)
+            shared.process_with_callable_range(0, 1024, policy);
+    } });
+
+    for (size_t threads : { 1, 2, 4, 8 }) {
+        benches.push_back({ "contention/shared/" + to_string(threads), threads, [&](BenchState& st) {
+            string out;
+            for (size_t i = 0; i < st.iterations; i++) {
+                shared.process_into("x", out);
+                keep(out);
+            }
+        } });
+        benches.push_back({ "contention/sharded/" + to_string(threads), threads, [&](BenchState& st) {
+            string out;
+            for (size_t i = 0; i < st.iterations; i++) {
+                sharded.process_into("x", out);
+                keep(out);
+            }
+        } });
+        benches.push_back({ "contention/queued/" + to_string(threads), threads, [&](BenchState& st) {
+            string out;
+            for (size_t i = 0; i < st.iterations; i++) {
+                queued.process_into("x", out);
+                keep(out);
+            }
+        } });
+    }
+
+    printf("%-32s %12s %12s %10s %10s %14s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op", "ops/s");
+    for (auto& bench : benches) {
+        if (filter && bench.name.find(filter) == string::npos)
+            continue;
+        report(bench, run_bench(bench, min_time));
+    }
+}
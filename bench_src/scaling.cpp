@@ -0,0 +1,304 @@
+#include "AllocCount.h"
+#include "LatencyHistogram.h"
+#include "Transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Sweeps each scenario over 1, 2, 4, ... threads and prints one JSON
+// document: throughput, latency percentiles and allocations per op for
+// every (scenario, threads) point. Every op is timed, so the clock reads
+// are part of the cost, the same in the baseline as in the run.
+//
+//   transport_scaling [--max-threads=N] [--duration=S] [--filter=NAME]
+//                     [--baseline=FILE [--threshold=F]]
+//
+// With --baseline, each point is checked against the one stored in FILE
+// (a previous run's output): the run fails if throughput drops, or p99
+// rises, by more than the threshold (default 0.1, i.e. 10%), or if any
+// allocation per op appears. The exit status is 1 on a regression.
+
+template<class T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Point {
+    string scenario;
+    size_t threads = 0;
+    uint64_t ops = 0;
+    double seconds = 0;
+    double ops_per_sec = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    double allocs_per_op = 0;
+    double bytes_per_op = 0;
+};
+
+typedef function<void ()> Op;
+
+struct Scenario {
+    string name;
+    // Runs once on each thread before the clock starts and returns the
+    // operation that thread repeats.
+    function<Op (size_t thread)> setup;
+};
+
+static Point run_point(const Scenario& scenario, size_t threads, double duration)
+{
+    vector<LatencyHistogram> latency(threads);
+    vector<uint64_t> ops(threads);
+    vector<AllocCount> allocs(threads);
+    atomic<size_t> ready{0};
+    atomic<bool> go{false};
+    atomic<bool> stop{false};
+
+    auto body = [&](size_t t) {
+        Op op = scenario.setup(t);
+        ready.fetch_add(1);
+        while (!go.load(memory_order_acquire))
+            this_thread::yield();
+
+        AllocCount before = thread_alloc_count();
+        uint64_t n = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            auto start = chrono::steady_clock::now();
+            op();
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            latency[t].record(uint64_t(ns));
+            n++;
+        }
+        allocs[t] = thread_alloc_count() - before;
+        ops[t] = n;
+    };
+
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++)
+        workers.emplace_back(body, t);
+    while (ready.load() < threads)
+        this_thread::yield();
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    this_thread::sleep_for(chrono::duration<double>(duration));
+    stop.store(true, memory_order_relaxed);
+    for (auto& w : workers)
+        w.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Point p;
+    p.scenario = scenario.name;
+    p.threads = threads;
+    LatencyHistogram total;
+    AllocCount alloc;
+    for (size_t t = 0; t < threads; t++) {
+        total.merge(latency[t]);
+        p.ops += ops[t];
+        alloc.allocs += allocs[t].allocs;
+        alloc.bytes += allocs[t].bytes;
+    }
+    p.seconds = seconds;
+    p.ops_per_sec = seconds > 0 ? p.ops / seconds : 0;
+    p.p50_ns = total.percentile(0.5);
+    p.p99_ns = total.percentile(0.99);
+    p.p999_ns = total.percentile(0.999);
+    p.allocs_per_op = p.ops ? double(alloc.allocs) / p.ops : 0;
+    p.bytes_per_op = p.ops ? double(alloc.bytes) / p.ops : 0;
+    return p;
+}
+
+// One point per line, so a baseline can be read back without a JSON parser.
+static void write_json(FILE* out, const vector<Point>& points)
+{
+    fprintf(out, "{\n  \"hardware_threads\": %u,\n  \"results\": [\n", thread::hardware_concurrency());
+    for (size_t i = 0; i < points.size(); i++) {
+        const Point& p = points[i];
+        fprintf(out,
+                "    {\"scenario\": \"%s\", \"threads\": %zu, \"ops\": %llu, \"seconds\": %.4f, \"ops_per_sec\": %.1f, "
+                "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"allocs_per_op\": %.4f, \"bytes_per_op\": %.2f}%s\n",
+                p.scenario.c_str(), p.threads, (unsigned long long)p.ops, p.seconds, p.ops_per_sec,
+                (unsigned long long)p.p50_ns, (unsigned long long)p.p99_ns, (unsigned long long)p.p999_ns,
+                p.allocs_per_op, p.bytes_per_op, i + 1 < points.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static bool json_field(const string& line, const char* key, double& value)
+{
+    string pattern = string("\"") + key + "\": ";
+    size_t pos = line.find(pattern);
+    if (pos == string::npos)
+        return false;
+    value = strtod(line.c_str() + pos + pattern.size(), nullptr);
+    return true;
+}
+
+static bool json_string(const string& line, const char* key, string& value)
+{
+    string pattern = string("\"") + key + "\": \"";
+    size_t pos = line.find(pattern);
+    if (pos == string::npos)
+        return false;
+    pos += pattern.size();
+    size_t end = line.find('"', pos);
+    if (end == string::npos)
+        return false;
+    value = line.substr(pos, end - pos);
+    return true;
+}
+
+static bool read_baseline(const char* path, map<pair<string, size_t>, Point>& baseline)
+{
+    ifstream in(path);
+    if (!in)
+        return false;
+    string line;
+    while (getline(in, line)) {
+        Point p;
+        double threads, ops_per_sec, p99, allocs;
+        if (!json_string(line, "scenario", p.scenario) || !json_field(line, "threads", threads)
+            || !json_field(line, "ops_per_sec", ops_per_sec) || !json_field(line, "p99_ns", p99)
+            || !json_field(line, "allocs_per_op", allocs))
+            continue;
+        p.threads = size_t(threads);
+        p.ops_per_sec = ops_per_sec;
+        p.p99_ns = uint64_t(p99);
+        p.allocs_per_op = allocs;
+        baseline[{ p.scenario, p.threads }] = p;
+    }
+    return true;
+}
+
+// Returns the number of regressed points; reports each one on stderr.
+static size_t compare(const vector<Point>& points, const map<pair<string, size_t>, Point>& baseline, double threshold)
+{
+    size_t regressions = 0;
+    for (const Point& p : points) {
+        auto it = baseline.find({ p.scenario, p.threads });
+        if (it == baseline.end()) {
+            fprintf(stderr, "%s/%zu: not in baseline\n", p.scenario.c_str(), p.threads);
+            continue;
+        }
+        const Point& b = it->second;
+        if (p.ops_per_sec < b.ops_per_sec * (1 - threshold)) {
+            fprintf(stderr, "%s/%zu: throughput %.0f ops/s, baseline %.0f\n", p.scenario.c_str(), p.threads, p.ops_per_sec, b.ops_per_sec);
+            regressions++;
+        }
+        // Percentiles are bucketed to 1/8 of a power of two, so allow a bucket.
+        if (p.p99_ns > b.p99_ns * (1 + threshold + 0.125)) {
+            fprintf(stderr, "%s/%zu: p99 %llu ns, baseline %llu\n", p.scenario.c_str(), p.threads,
+                    (unsigned long long)p.p99_ns, (unsigned long long)b.p99_ns);
+            regressions++;
+        }
+        // Allocation counts are deterministic; any new one is a regression.
+        if (p.allocs_per_op > b.allocs_per_op + 0.01) {
+            fprintf(stderr, "%s/%zu: %.2f allocs/op, baseline %.2f\n", p.scenario.c_str(), p.threads, p.allocs_per_op, b.allocs_per_op);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_threads = 64;
+    double duration = 0.2;
+    double threshold = 0.1;
+    const char* filter = nullptr;
+    const char* baseline_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--max-threads=", 14) == 0)
+            max_threads = max<size_t>(1, strtoul(argv[i] + 14, nullptr, 10));
+        else if (strncmp(argv[i], "--duration=", 11) == 0)
+            duration = atof(argv[i] + 11);
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+            baseline_path = argv[i] + 11;
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+            threshold = atof(argv[i] + 12);
+        else {
+            fprintf(stderr, "usage: %s [--max-threads=N] [--duration=S] [--filter=NAME] [--baseline=FILE [--threshold=F]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    map<pair<string, size_t>, Point> baseline;
+    if (baseline_path && !read_baseline(baseline_path, baseline)) {
+        fprintf(stderr, "%s: cannot read baseline\n", baseline_path);
+        return 2;
+    }
+
+    Transport shared("scaling");
+    vector<Scenario> scenarios;
+
+    // Every thread calls through the one handle.
+    scenarios.push_back({ "shared", [&](size_t) -> Op {
+        return [&, out = string()]() mutable {
+            shared.process_into("x", out);
+            keep(out);
+        };
+    } });
+
+    // Each thread opens its own handle, so nothing is shared but the process.
+    scenarios.push_back({ "per_thread", [](size_t t) -> Op {
+        auto handle = make_shared<Transport>("scaling" + to_string(t));
+        return [handle, out = string()]() mutable {
+            handle->process_into("x", out);
+            keep(out);
+        };
+    } });
+
+    // A copy per call, as when handles are passed by value to each task.
+    scenarios.push_back({ "fanout", [&](size_t) -> Op {
+        return [&, out = string()]() mutable {
+            Transport copy = shared;
+            copy.process_into("x", out);
+            keep(out);
+        };
+    } });
+
+    // Three process_into calls to one small callable.
+    scenarios.push_back({ "mixed", [&](size_t t) -> Op {
+        return [&, t, n = size_t(0), out = string()]() mutable {
+            if (++n % 4) {
+                shared.process_into("x", out);
+                keep(out);
+            } else {
+                shared.process_with_callable([t](size_t arg) { return Transport::make_uuid(t, arg); });
+            }
+        };
+    } });
+
+    vector<Point> points;
+    for (auto& scenario : scenarios) {
+        if (filter && scenario.name.find(filter) == string::npos)
+            continue;
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            points.push_back(run_point(scenario, threads, duration));
+            fprintf(stderr, "%s/%zu: %.0f ops/s\n", scenario.name.c_str(), threads, points.back().ops_per_sec);
+        }
+    }
+
+    write_json(stdout, points);
+
+    if (!baseline_path)
+        return 0;
+    size_t regressions = compare(points, baseline, threshold);
+    fprintf(stderr, "%zu regressions against %s (threshold %.0f%%)\n", regressions, baseline_path, threshold * 100);
+    return regressions ? 1 : 0;
+}
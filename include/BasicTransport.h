@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Transport.h"
+
+#include <string>
+#include <utility>
+
+// Transport for a backend type known at compile time. Copies share one
+// ImplT, held through the refcount embedded in Transport::Impl, and calls go
+// straight to ImplT (declare it final) so they can be inlined. to_transport()
+// gives a type-erased handle to the same ImplT for code that needs the stable
+// interface. ImplT provides
+//     static IntrusivePtr<ImplT> create(TransportError&, std::string_view name, const Transport::Options&)
+// returning null, with the error set, when the open fails.
+template<class ImplT>
+class BasicTransport {
+public:
+    explicit BasicTransport(std::string_view name, const Transport::Options& opts = Transport::Options())
+        : pImpl(ImplT::create(open_err, name, opts))
+    {
+        if (pImpl && opts.thread_confined)
+            pImpl->confine_to_thread();
+    }
+
+    bool is_open() const    { return pImpl != nullptr; }
+    TransportError error() const { return open_err; }
+    std::string open_error() const { return transport_error_message(open_err); }
+    size_t use_count() const { if (pImpl) return pImpl->ref_count(); return 0; }
+    bool is_same(const BasicTransport& other) const { return pImpl && pImpl == other.pImpl; }
+
+    ImplT& impl() const
+    {
+        if (!pImpl)
+            throw_transport_closed(open_err);
+        return *pImpl;
+    }
+
+    std::string process(std::string_view arg) { return impl().process(arg); }
+    std::string process(const std::string& arg) { return impl().process(arg); }
+    std::string process(const char* arg) { return impl().process(arg); }
+    std::string process(std::string&& arg) { return impl().process_owned(std::move(arg)); }
+    void process_into(std::string_view arg, std::string& out) { impl().process_into(arg, out); }
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out) { impl().process_batch(args, out); }
+
+    template<class F>
+        requires std::is_invocable_r_v<Transport::Uuid, F&, size_t>
+    void process_with_callable(F&& func) { impl().process_with_callable(FunctionRef<Transport::Uuid (size_t)>(func)); }
+
+    size_t total_processed() const { return impl().total_processed(); }
+
+    // Shares the same refcount, so this costs one increment and no allocation.
+    Transport to_transport() const { return Transport(open_err, IntrusivePtr<Transport::Impl>(pImpl)); }
+
+private:
+    // Declared first: the constructor's create() call sets it.
+    TransportError open_err = TransportError::none;
+    IntrusivePtr<ImplT> pImpl;
+};
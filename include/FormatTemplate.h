@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// A string literal usable as a template argument.
+template<std::size_t N>
+struct FixedString {
+    char chars[N] = {};
+
+    constexpr FixedString(const char (&s)[N])
+    {
+        for (std::size_t i = 0; i < N; i++)
+            chars[i] = s[i];
+    }
+
+    constexpr std::string_view view() const { return std::string_view(chars, N - 1); }
+};
+
+// One argument of a FormatTemplate: text is referenced where it is, integers
+// are converted into the field itself. Built in place and never copied, so
+// text can point at digits.
+class FormatField {
+public:
+    FormatField(std::string_view s) noexcept : text(s) {}
+
+    template<std::integral T>
+        requires (!std::is_same_v<T, bool> && !std::is_same_v<T, char>)
+    FormatField(T value) noexcept
+        : text(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits)
+    {
+    }
+
+    FormatField(const FormatField&) = delete;
+    FormatField& operator=(const FormatField&) = delete;
+
+    std::string_view view() const { return text; }
+
+private:
+    char digits[std::numeric_limits<long long>::digits10 + 2];
+    std::string_view text;
+};
+
+// An output layout fixed at compile time, where each "{}" in Pattern is
+// replaced by the next argument. The pattern is split into its literal
+// segments during compilation, so a call only converts the integer
+// arguments, sums the exact size, reserves once and appends each piece once.
+//
+//   FormatTemplate<"{}+{}">::format_to(out, name, seq);
+template<FixedString Pattern>
+struct FormatTemplate {
+    struct Segment {
+        std::size_t pos;
+        std::size_t len;
+    };
+
+    // Plain index loops over Pattern.chars: string_view::find is not a
+    // constant expression in sanitizer builds of GCC 12.
+    static constexpr std::size_t pattern_size = sizeof(Pattern.chars) - 1;
+
+    static constexpr bool is_field(std::size_t i)
+    {
+        return i + 1 < pattern_size && Pattern.chars[i] == '{' && Pattern.chars[i + 1] == '}';
+    }
+
+    static constexpr std::size_t field_count = [] {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < pattern_size; i++) {
+            if (is_field(i)) {
+                n++;
+                i++;
+            }
+        }
+        return n;
+    }();
+
+    // The literal text before each field, then the text after the last one.
+    static constexpr std::array<Segment, field_count + 1> segments = [] {
+        std::array<Segment, field_count + 1> out{};
+        std::size_t f = 0;
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < pattern_size; i++) {
+            if (is_field(i)) {
+                out[f++] = { start, i - start };
+                start = i + 2;
+                i++;
+            }
+        }
+        out[field_count] = { start, pattern_size - start };
+        return out;
+    }();
+
+    static constexpr std::size_t literal_size = pattern_size - 2 * field_count;
+
+    static_assert([] {
+        for (std::size_t i = 0; i < pattern_size; i++) {
+            if (is_field(i))
+                i++;
+            else if (Pattern.chars[i] == '{' || Pattern.chars[i] == '}')
+                return false;
+        }
+        return true;
+    }(), "FormatTemplate patterns only support {} fields");
+
+    // Exact length of the output for these arguments.
+    template<class... Args>
+        requires (sizeof...(Args) == field_count)
+    static std::size_t size(const Args&... args)
+    {
+        const FormatField fields[field_count + 1] = { FormatField(args)..., FormatField(std::string_view()) };
+        return sized(fields);
+    }
+
+    // Overwrites out; String is any std::basic_string<char>, and out keeps
+    // its allocator.
+    template<class String, class... Args>
+        requires (sizeof...(Args) == field_count)
+    static void format_to(String& out, const Args&... args)
+    {
+        out.clear();
+        append_to(out, args...);
+    }
+
+    template<class String, class... Args>
+        requires (sizeof...(Args) == field_count)
+    static void append_to(String& out, const Args&... args)
+    {
+        const FormatField fields[field_count + 1] = { FormatField(args)..., FormatField(std::string_view()) };
+        out.reserve(out.size() + sized(fields));
+        append_pieces(out, fields, std::make_index_sequence<field_count>());
+    }
+
+    template<class... Args>
+        requires (sizeof...(Args) == field_count)
+    static std::string format(const Args&... args)
+    {
+        std::string out;
+        append_to(out, args...);
+        return out;
+    }
+
+private:
+    static std::size_t sized(const FormatField* fields)
+    {
+        std::size_t size = literal_size;
+        for (std::size_t f = 0; f < field_count; f++)
+            size += fields[f].view().size();
+        return size;
+    }
+
+    // Segment offsets are template arguments here, so each literal append
+    // is a copy of a known length.
+    template<class String, std::size_t... I>
+    static void append_pieces(String& out, const FormatField* fields, std::index_sequence<I...>)
+    {
+        ((literal<segments[I].pos, segments[I].len>(out), out.append(fields[I].view())), ...);
+        literal<segments[field_count].pos, segments[field_count].len>(out);
+    }
+
+    template<std::size_t Pos, std::size_t Len, class String>
+    static void literal(String& out)
+    {
+        if constexpr (Len != 0)
+            out.append(Pattern.chars + Pos, Len);
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template<class Sig> class FunctionRef;
+
+// Non-owning, non-allocating reference to a callable. It must not outlive the
+// callable it refers to, which makes it a fit for callbacks that are only
+// invoked synchronously.
+template<class R, class... Args>
+class FunctionRef<R (Args...)> {
+public:
+    template<class F>
+        requires (!std::is_same_v<std::remove_cvref_t<F>, FunctionRef> && std::is_invocable_r_v<R, F&, Args...>)
+    FunctionRef(F&& f) noexcept : call(&invoke<std::remove_reference_t<F>>)
+    {
+        if constexpr (std::is_function_v<std::remove_reference_t<F>>)
+            target.fn = reinterpret_cast<void (*)()>(&f);
+        else
+            target.obj = const_cast<void*>(static_cast<const void*>(std::addressof(f)));
+    }
+
+    R operator()(Args... args) const { return call(target, std::forward<Args>(args)...); }
+
+private:
+    union Target {
+        void* obj;
+        void (*fn)();
+    };
+
+    template<class F>
+    static R invoke(Target target, Args... args)
+    {
+        F* f;
+        if constexpr (std::is_function_v<F>)
+            f = reinterpret_cast<F*>(target.fn);
+        else
+            f = static_cast<F*>(target.obj);
+
+        if constexpr (std::is_void_v<R>)
+            std::invoke(*f, std::forward<Args>(args)...);
+        else
+            return std::invoke(*f, std::forward<Args>(args)...);
+    }
+
+    Target target;
+    R (*call)(Target, Args...);
+};
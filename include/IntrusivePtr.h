@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Owning pointer to an object that carries its own count, via T::retain()
+// and T::release(); release() frees the object once the count reaches zero.
+// Unlike shared_ptr there is no separate control block and no weak count.
+template<class T>
+class IntrusivePtr {
+public:
+    IntrusivePtr() noexcept = default;
+    IntrusivePtr(std::nullptr_t) noexcept {}
+    // Adds a reference to p.
+    explicit IntrusivePtr(T* p) noexcept : p(p) { if (p) p->retain(); }
+    IntrusivePtr(const IntrusivePtr& other) noexcept : IntrusivePtr(other.p) {}
+    IntrusivePtr(IntrusivePtr&& other) noexcept : p(std::exchange(other.p, nullptr)) {}
+
+    template<class U>
+        requires std::is_convertible_v<U*, T*>
+    IntrusivePtr(const IntrusivePtr<U>& other) noexcept : IntrusivePtr(other.get()) {}
+
+    template<class U>
+        requires std::is_convertible_v<U*, T*>
+    IntrusivePtr(IntrusivePtr<U>&& other) noexcept : p(other.detach()) {}
+
+    ~IntrusivePtr() { if (p) p->release(); }
+
+    IntrusivePtr& operator=(IntrusivePtr other) noexcept
+    {
+        std::swap(p, other.p);
+        return *this;
+    }
+
+    // Takes over a reference the caller already holds.
+    static IntrusivePtr adopt(T* p) noexcept
+    {
+        IntrusivePtr result;
+        result.p = p;
+        return result;
+    }
+
+    // Gives up the reference without releasing it.
+    T* detach() noexcept { return std::exchange(p, nullptr); }
+
+    T* get() const noexcept { return p; }
+    T* operator->() const noexcept { return p; }
+    T& operator*() const noexcept { return *p; }
+    explicit operator bool() const noexcept { return p != nullptr; }
+
+    friend bool operator==(const IntrusivePtr& a, const IntrusivePtr& b) noexcept { return a.p == b.p; }
+
+private:
+    T* p = nullptr;
+};
+
+template<class T, class... Args>
+IntrusivePtr<T> make_intrusive(Args&&... args)
+{
+    return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
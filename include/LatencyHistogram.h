@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram in the style of HdrHistogram. Values below 16 get a
+// bucket each; above that every power of two is split into 8 buckets, so a
+// value is never more than 12.5% above its bucket's lower bound. Values
+// saturate at 2^max_bits - 1.
+struct LatencyHistogram {
+    static constexpr unsigned sub_bits = 3;
+    static constexpr unsigned max_bits = 40;
+    static constexpr size_t exact = size_t(2) << sub_bits;
+    static constexpr size_t bucket_count = exact + (max_bits - sub_bits - 1) * (size_t(1) << sub_bits);
+
+    std::array<std::uint64_t, bucket_count> counts{};
+
+    static constexpr size_t bucket_of(std::uint64_t value)
+    {
+        if (value >> max_bits)
+            value = (std::uint64_t(1) << max_bits) - 1;
+        unsigned width = std::bit_width(value);
+        if (width <= sub_bits + 1)
+            return size_t(value);
+        unsigned shift = width - (sub_bits + 1);
+        return exact + (shift - 1) * (size_t(1) << sub_bits) + size_t((value >> shift) - (std::uint64_t(1) << sub_bits));
+    }
+
+    static constexpr std::uint64_t lower_bound(size_t bucket)
+    {
+        if (bucket < exact)
+            return bucket;
+        bucket -= exact;
+        unsigned shift = unsigned(bucket >> sub_bits) + 1;
+        std::uint64_t top = (bucket & ((size_t(1) << sub_bits) - 1)) + (std::uint64_t(1) << sub_bits);
+        return top << shift;
+    }
+
+    void record(std::uint64_t value, std::uint64_t n = 1) { counts[bucket_of(value)] += n; }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < bucket_count; i++)
+            counts[i] += other.counts[i];
+    }
+
+    std::uint64_t count() const
+    {
+        std::uint64_t total = 0;
+        for (std::uint64_t c : counts)
+            total += c;
+        return total;
+    }
+
+    // Lower bound of the bucket holding the q-quantile (0 <= q <= 1); 0 when
+    // nothing was recorded.
+    std::uint64_t percentile(double q) const
+    {
+        std::uint64_t total = count();
+        if (total == 0)
+            return 0;
+        std::uint64_t rank = std::uint64_t(q * double(total) + 0.5);
+        if (rank == 0)
+            rank = 1;
+        std::uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            seen += counts[i];
+            if (seen >= rank)
+                return lower_bound(i);
+        }
+        return lower_bound(bucket_count - 1);
+    }
+};
+
+static_assert(LatencyHistogram::bucket_of(15) == 15);
+static_assert(LatencyHistogram::lower_bound(LatencyHistogram::bucket_of(31)) == 30);
+static_assert(LatencyHistogram::bucket_of(~std::uint64_t(0)) == LatencyHistogram::bucket_count - 1);
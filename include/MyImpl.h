@@ -0,0 +1,253 @@
+#pragma once
+
+#include "FormatTemplate.h"
+#include "Transport.h"
+#include "ThreadShard.h"
+#include "TransportLog.h"
+#include "TransportTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+// The built-in backend behind plain Transport names. It lives in a header so
+// BasicTransport<MyImpl> can call it without virtual dispatch.
+struct MyImpl final : public Transport::Impl {
+    // Memory the Impl was placed in by create(); null when it came from new.
+    std::pmr::memory_resource* owner = nullptr;
+    // "name+", formatted once; every result starts with it.
+    std::pmr::string prefix;
+    // Each value is handed out exactly once. Values seen by a single thread
+    // increase strictly, a batch gets a contiguous range, and across threads
+    // the order is the counter's modification order. The increment is relaxed:
+    // it orders nothing but the counter itself.
+    std::atomic<size_t> counter{0};
+
+    // Sharded mode only. A thread always claims from shard
+    // thread_shard_index() % shard_count, so with up to shard_count threads
+    // each shard has a single writer; beyond that, shards are shared but
+    // values stay unique within a shard.
+    struct alignas(64) Shard { std::atomic<size_t> count{0}; };
+    static constexpr size_t shard_count = 64;
+    static constexpr size_t no_shard = size_t(-1);
+    std::pmr::vector<Shard> shards;
+
+    // prefix and shards allocate from resource, or the default resource if null.
+    MyImpl(std::string_view name, const Transport::Options& opts, std::pmr::memory_resource* resource = nullptr)
+        : prefix(resource ? resource : std::pmr::get_default_resource()),
+          shards(opts.sharded_counters ? shard_count : 0, prefix.get_allocator())
+    {
+        FormatTemplate<"{}+">::format_to(prefix, name);
+        TRANSPORT_LOG(debug, "{} {}", this->name(), counter.load());
+    }
+
+    std::string_view name() const { return std::string_view(prefix).substr(0, prefix.size() - 1); }
+
+    // Places the Impl itself in resource as well; with a null resource this is
+    // make_intrusive. The name "fail" is refused before anything is allocated.
+    static IntrusivePtr<MyImpl> create(TransportError& error, std::string_view name, const Transport::Options& opts,
+                                       std::pmr::memory_resource* resource = nullptr)
+    {
+        if (name == "fail") {
+            error = TransportError::name_rejected;
+            return nullptr;
+        }
+        if (!resource)
+            return make_intrusive<MyImpl>(name, opts);
+
+        void* mem = resource->allocate(sizeof(MyImpl), alignof(MyImpl));
+        MyImpl* impl;
+        try {
+            impl = new (mem) MyImpl(name, opts, resource);
+        } catch (...) {
+            resource->deallocate(mem, sizeof(MyImpl), alignof(MyImpl));
+            throw;
+        }
+        impl->owner = resource;
+        return IntrusivePtr<MyImpl>(impl);
+    }
+
+    void destroy() noexcept override
+    {
+        TRANSPORT_TRACE_SCOPE("MyImpl::destroy", this, 0);
+        std::pmr::memory_resource* resource = owner;
+        if (!resource) {
+            delete this;
+            return;
+        }
+        this->~MyImpl();
+        resource->deallocate(this, sizeof(MyImpl), alignof(MyImpl));
+    }
+
+    ~MyImpl()
+    {
+        TRANSPORT_LOG(debug, "{} {}", name(), total_processed());
+    }
+
+    std::string process(std::string_view arg)
+    {
+        std::string out;
+        process_into(arg, out);
+        return out;
+    }
+
+    // Builds the result around arg, in arg's own buffer.
+    std::string process_owned(std::string&& arg)
+    {
+        size_t shard;
+        size_t seq = claim(1, shard);
+        arg.reserve(prefix.size() + arg.size() + 2 + 2 * (std::numeric_limits<size_t>::digits10 + 1));
+        arg.insert(0, prefix);
+        append_seq(shard, seq, arg);
+        return std::move(arg);
+    }
+
+    void process_into(std::string_view arg, std::string& out)
+    {
+        size_t shard;
+        size_t seq = claim(1, shard);
+        format(arg, shard, seq, out);
+    }
+
+    void process_into(std::string_view arg, std::pmr::string& out)
+    {
+        size_t shard;
+        size_t seq = claim(1, shard);
+        format(arg, shard, seq, out);
+    }
+
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out)
+    {
+        size_t shard;
+        size_t first = claim(args.size(), shard);
+
+        out.resize(args.size());
+        for (size_t i = 0; i < args.size(); i++)
+            format(args[i], shard, first + i, out[i]);
+    }
+
+    // Only the separators and digits are copied, into out's inline buffer;
+    // prefix and the input fragments are referenced where they are.
+    void process_fragments(std::span<const std::string_view> in, TransportFragments& out)
+    {
+        size_t shard;
+        size_t seq = claim(1, shard);
+
+        char digits[2 * (std::numeric_limits<size_t>::digits10 + 1) + 2];
+        char* end = digits;
+        *end++ = '+';
+        if (shard != no_shard) {
+            end = std::to_chars(end, digits + sizeof(digits), shard).ptr;
+            *end++ = ':';
+        }
+        end = std::to_chars(end, digits + sizeof(digits), seq).ptr;
+
+        out.clear();
+        out.append(prefix);
+        for (std::string_view part : in)
+            out.append(part);
+        out.append_copy(std::string_view(digits, end - digits));
+    }
+
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func)
+    {
+        Transport::Uuid uuid = func(345);
+        TRANSPORT_LOG(info, "got {} from callable", uuid);
+    }
+
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, std::span<Transport::Uuid>)> fill)
+    {
+        if (count == 0)
+            return;
+
+        static constexpr size_t chunk = 256;
+        std::vector<Transport::Uuid> buf(std::min(count, chunk));
+        Transport::Uuid head, tail;
+        for (size_t done = 0; done < count; ) {
+            std::span<Transport::Uuid> out(buf.data(), std::min(count - done, chunk));
+            fill(first + done, out);
+            if (done == 0)
+                head = out.front();
+            tail = out.back();
+            done += out.size();
+        }
+        TRANSPORT_LOG(info, "got {} from callable range, first {} last {}", count, head, tail);
+    }
+
+    // The counter value is claimed when the stream opens, so the prefix goes
+    // out at once and each chunk passes straight through; only "+seq" waits
+    // for the end.
+    struct Stream : Transport::StreamState {
+        size_t shard;
+        size_t seq;
+    };
+
+    std::unique_ptr<Transport::StreamState> stream_open()
+    {
+        auto s = std::make_unique<Stream>();
+        s->seq = claim(1, s->shard);
+        s->pending.append(prefix);
+        return s;
+    }
+
+    void feed(Transport::StreamState& state, std::string_view chunk, bool last)
+    {
+        auto& s = static_cast<Stream&>(state);
+        s.pending.append(chunk);
+        if (last) {
+            append_seq(s.shard, s.seq, s.pending);
+            s.input_done = true;
+        }
+    }
+
+    size_t drain(Transport::StreamState& state, std::span<char> out)
+    {
+        return state.take(out);
+    }
+
+    size_t total_processed() const
+    {
+        if (shards.empty())
+            return counter.load(std::memory_order_relaxed);
+
+        size_t total = 0;
+        for (size_t i = 0; i < shard_count; i++)
+            total += shards[i].count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    // Claims n consecutive values; shard is no_shard for the shared counter.
+    size_t claim(size_t n, size_t& shard)
+    {
+        if (shards.empty()) {
+            shard = no_shard;
+            return counter.fetch_add(n, std::memory_order_relaxed);
+        }
+        shard = thread_shard_index() % shard_count;
+        return shards[shard].count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void append_seq(size_t shard, size_t seq, std::string& out) const
+    {
+        if (shard == no_shard)
+            FormatTemplate<"+{}">::append_to(out, seq);
+        else
+            FormatTemplate<"+{}:{}">::append_to(out, shard, seq);
+    }
+
+    // String is std::string or std::pmr::string; out keeps its allocator.
+    template<class String>
+    void format(std::string_view arg, size_t shard, size_t seq, String& out) const
+    {
+        if (shard == no_shard)
+            FormatTemplate<"{}{}+{}">::format_to(out, prefix, arg, seq);
+        else
+            FormatTemplate<"{}{}+{}:{}">::format_to(out, prefix, arg, shard, seq);
+    }
+};
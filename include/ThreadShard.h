@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+// Indices of exited threads, handed out again lowest first so the live
+// threads keep a dense range. Never destroyed: threads still exit after
+// static destructors have run.
+struct ThreadShardIds {
+    std::mutex lock;
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> free;
+    size_t next = 0;
+
+    static ThreadShardIds& get()
+    {
+        static ThreadShardIds* ids = new ThreadShardIds;
+        return *ids;
+    }
+};
+
+// Holds the calling thread's index and gives it back when the thread exits.
+struct ThreadShardSlot {
+    size_t index;
+
+    ThreadShardSlot()
+    {
+        auto& ids = ThreadShardIds::get();
+        std::lock_guard<std::mutex> guard(ids.lock);
+        if (ids.free.empty()) {
+            index = ids.next++;
+        } else {
+            index = ids.free.top();
+            ids.free.pop();
+        }
+    }
+
+    ~ThreadShardSlot()
+    {
+        auto& ids = ThreadShardIds::get();
+        std::lock_guard<std::mutex> guard(ids.lock);
+        ids.free.push(index);
+    }
+
+    ThreadShardSlot(const ThreadShardSlot&) = delete;
+    ThreadShardSlot& operator=(const ThreadShardSlot&) = delete;
+};
+
+// Dense per-thread id, assigned on first use and recycled when the thread
+// exits, so a service with short-lived threads keeps spreading them over
+// every shard. Used to pick a shard so that a thread keeps writing the same
+// cache line.
+inline size_t thread_shard_index()
+{
+    thread_local ThreadShardSlot slot;
+    return slot.index;
+}
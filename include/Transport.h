@@ -1,32 +1,592 @@
 #pragma once
 
+#include "FunctionRef.h"
+#include "IntrusivePtr.h"
+#include "LatencyHistogram.h"
+#include "TransportFragments.h"
+#include "TransportFuture.h"
+#include "Uuid128.h"
+
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <functional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class TransportRef;
+class TransportStream;
+class TransportRecorder;
+
+// Why an open failed. A handle carries just the code; the message is only
+// produced when someone asks for it.
+enum class TransportError : std::uint8_t {
+    none,
+    no_backend,     // nothing registered for the name's scheme
+    name_rejected,  // the backend refused the name
+    backend_failed, // the factory returned no Impl without saying why
+    bad_options,    // the Options asked for modes that cannot be combined
+};
+
+inline const char* transport_error_message(TransportError error)
+{
+    switch (error) {
+    case TransportError::none:           return "";
+    case TransportError::no_backend:     return "no backend for scheme";
+    case TransportError::name_rejected:  return "name rejected by backend";
+    case TransportError::backend_failed: return "backend failed to open";
+    case TransportError::bad_options:    return "incompatible options";
+    }
+    return "unknown error";
+}
+
+// Thrown by calls on a handle that isn't open.
+[[noreturn]] void throw_transport_closed(TransportError error);
 
 class Transport {
 public:
     struct Impl;
+    struct StreamState;
+#ifdef TRANSPORT_STRING_UUID
     typedef std::string Uuid;
+#else
+    typedef Uuid128 Uuid;
+#endif
+
+    // Builds a Uuid in whichever representation this build uses.
+    static Uuid make_uuid(std::uint64_t hi, std::uint64_t lo)
+    {
+#ifdef TRANSPORT_STRING_UUID
+        return Uuid128::from_u64(hi, lo).to_string();
+#else
+        return Uuid128::from_u64(hi, lo);
+#endif
+    }
+
+    // What a queued handle does when its ring is full: wait for a slot,
+    // drop the message (the result comes back empty), or throw.
+    enum class Backpressure { block, drop, fail_fast };
+
+    struct Options {
+        // Count on a per-thread, cache-line sized shard instead of one shared
+        // counter. Results carry "shard:seq" in place of the global counter.
+        bool sharded_counters = false;
+
+        // When nonzero, process calls from every copy of the handle are queued
+        // in a bounded lock-free ring of this many slots and a single thread
+        // feeds them to the Impl in batches; the Impl sees one thread at a
+        // time. If a batch throws, each of its requests is retried alone, so
+        // an error only reaches the caller whose argument caused it.
+        size_t queue_capacity = 0;
+        Backpressure backpressure = Backpressure::block;
+
+        // Promise that every copy of the handle stays on the creating thread,
+        // so copies can adjust the refcount with plain loads and stores.
+        // The open fails with bad_options when queue_capacity is set too, and
+        // process_async on such a handle throws logic_error.
+        bool thread_confined = false;
+
+        // Wraps the Impl in a layer that records call counts, bytes and
+        // latencies for stats(). Without it no layer is added at all.
+        bool metrics = false;
+
+        // Appends every process, process_into and process_batch call, with
+        // its result and timing, to this log for transport_replay. Not owned;
+        // it must outlive every copy of the handle.
+        TransportRecorder* recorder = nullptr;
+
+        // When nonzero and the Impl reports idempotent, results of process,
+        // process_into and process_batch are memoized by argument in a
+        // sharded CLOCK cache of about this many entries. Ignored otherwise.
+        size_t cache_capacity = 0;
+
+        // Keep only the name and options and run the factory, with all the
+        // layers above, once on first use; concurrent first calls wait for
+        // the one open. Use warm() to pay for it off the critical path.
+        bool lazy = false;
+
+        // Opens one replica of the whole stack per NUMA node, each from a
+        // thread pinned to that node so its memory is node-local, and sends
+        // every call to the replica of the caller's current node. Counters
+        // are per replica, so results are unique within a node only;
+        // total_processed() and the stats sum every replica. Streams are
+        // joined and go through process(). One node means no replicas.
+        // A memory_resource passed to the constructor is ignored when there
+        // are replicas: one arena would put every node's Impl in the same
+        // memory, so each replica uses the default heap instead.
+        bool numa_replicas = false;
+
+        // Pins a queued handle's drain thread to this CPU; -1 leaves it
+        // alone. Replicas ignore it: their drain threads stay on their node.
+        int drain_cpu = -1;
+    };
+
+    // Bits of capabilities().
+    // The result depends only on the argument, so calls may be answered from
+    // a cache; counters such as total_processed() then only see misses.
+    static constexpr unsigned idempotent = 1u << 0;
+
+    struct CacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    struct QueueStats {
+        size_t depth = 0;
+        size_t capacity = 0;
+        size_t high_water = 0;
+        size_t enqueued = 0;
+        size_t dropped = 0;
+        size_t rejected = 0;
+    };
+
+    // Latencies are in nanoseconds and cover the whole call, including any
+    // time spent queued.
+    struct CallStats {
+        std::uint64_t calls = 0;
+        std::uint64_t bytes_in = 0;
+        std::uint64_t bytes_out = 0;
+        std::uint64_t total_ns = 0;
+        LatencyHistogram latency;
+    };
+
+    struct Stats {
+        bool instrumented = false;
+        CallStats process;      // process and process_into
+        CallStats batch;
+        CallStats callable;     // both callable forms; no bytes recorded
+    };
 
-    Transport(const std::string& name);
+    // Receives snapshots of Impls opened with Options::metrics: from
+    // export_stats(), and a final one as each such Impl is destroyed.
+    // Runs on the thread that triggered the export.
+    struct StatsExporter {
+        virtual ~StatsExporter() = default;
+        virtual void export_stats(std::string_view name, const Stats& stats) = 0;
+    };
 
-    bool is_open() const    { return open_fail_desc.empty(); }
-    std::string open_error() const { return open_fail_desc; }
-    size_t use_count() const { if (pImpl) return pImpl.use_count(); return 0; }
-    bool is_same(const Transport& other) const { return this->pImpl == other.pImpl; }
+    // name is only read during the call, so it can point into a larger buffer.
+    // A failed open leaves the handle closed, holding only the error code;
+    // calls on it throw std::runtime_error.
+    Transport(std::string_view name);
+    Transport(std::string_view name, const Options& opts);
+    // Backends that support it build the Impl, and everything it owns, in
+    // memory from resource; others ignore it. resource must outlive every
+    // copy of the handle. Front-end layers (queue, interning) stay on the
+    // heap, and so does everything under Options::numa_replicas.
+    Transport(std::string_view name, const Options& opts, std::pmr::memory_resource* resource);
 
-    std::string process(const std::string& arg);
+    // Kept for compatibility; the const char* forms keep literals unambiguous.
+    Transport(const std::string& name) : Transport(std::string_view(name)) {}
+    Transport(const std::string& name, const Options& opts) : Transport(std::string_view(name), opts) {}
+    Transport(const char* name) : Transport(std::string_view(name)) {}
+    Transport(const char* name, const Options& opts) : Transport(std::string_view(name), opts) {}
+
+    // Copies share the Impl and cost one refcount increment. Moves cost
+    // nothing; the moved-from handle is closed, with error() none.
+    Transport(const Transport&) = default;
+    Transport& operator=(const Transport&) = default;
+    Transport(Transport&& other) noexcept
+        : open_err(std::exchange(other.open_err, TransportError::none)), pImpl(std::move(other.pImpl)) {}
+    Transport& operator=(Transport&& other) noexcept
+    {
+        open_err = std::exchange(other.open_err, TransportError::none);
+        pImpl = std::move(other.pImpl);
+        return *this;
+    }
+
+    // Returns no handle at all when the open fails, and sets error to why.
+    // A lazy open can't fail yet, so it always returns a handle.
+    static std::optional<Transport> try_open(std::string_view name, TransportError& error);
+    static std::optional<Transport> try_open(std::string_view name, const Options& opts, TransportError& error);
+
+    struct AsyncOptions {
+        // Worker threads in the library's pool; 0 means one per hardware thread.
+        size_t threads = 0;
+        // Pins worker i to the i-th CPU, node by node, so a worker keeps its
+        // cache and memory node.
+        bool pin_workers = false;
+    };
+
+    // Sizes the pool behind process_async. Only possible before the first
+    // asynchronous call; returns false once the pool exists.
+    static bool configure_async(const AsyncOptions& opts);
+
+    // NUMA nodes with CPUs, as used by Options::numa_replicas.
+    static size_t numa_nodes();
+
+    // Returns a handle to the process-wide Impl interned under name, opening
+    // it on first use. The entry is dropped when its last handle goes away.
+    static Transport open_shared(std::string_view name);
+
+    // A lazy handle counts as open until its deferred open has been tried
+    // and failed; after that it is closed and error() says why.
+    bool is_open() const;
+    TransportError error() const;
+    std::string open_error() const { return transport_error_message(error()); }
+    // Opens a lazy handle now; returns is_open(). A no-op on other handles.
+    bool warm();
+    size_t use_count() const;
+    bool is_same(const Transport& other) const { return pImpl && this->pImpl == other.pImpl; }
+
+    // Non-owning view for calls that don't need to extend the Impl's
+    // lifetime; it does no refcount traffic and must not outlive this handle.
+    TransportRef borrow() const;
+
+    std::string process(std::string_view arg);
+    std::string process(const std::string& arg) { return process(std::string_view(arg)); }
+    std::string process(const char* arg) { return process(std::string_view(arg)); }
+    // Hands arg's buffer to the Impl, which may build the result in it.
+    std::string process(std::string&& arg);
+    void process_into(std::string_view arg, std::string& out);
+    // Builds the result with out's allocator, so per-request scratch can come
+    // from an arena that is released in one go.
+    void process_into(std::string_view arg, std::pmr::string& out);
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out);
+    // One call whose argument is the concatenation of in; the result comes
+    // back as parts of out. Parts may point into in, and into storage the
+    // Impl owns (such as its name prefix), so keep in alive, and this handle
+    // or a copy of it, while out is used.
+    void process_fragments(std::span<const std::string_view> in, TransportFragments& out);
+
+    // Starts a session that takes the argument in chunks and hands the result
+    // out as it is produced; see TransportStream.
+    TransportStream open_stream();
+
+    // Runs process(arg) on the library's work-stealing pool. The call holds a
+    // copy of this handle, so the Impl stays alive until it completes.
+    TransportFuture<std::string> process_async(std::string_view arg);
 
     void process_with_callable(std::function<Uuid (size_t)>);
+    void process_with_callable(FunctionRef<Uuid (size_t)> func);
+
+    // Lambdas and other callables bind by reference here, so neither a
+    // std::function nor a copy of the callable is made.
+    template<class F>
+        requires std::is_invocable_r_v<Uuid, F&, size_t>
+    void process_with_callable(F&& func) { process_with_callable(FunctionRef<Uuid (size_t)>(func)); }
+
+    // Produces a Uuid for every index in [first, first + count). The Impl hands
+    // out buffers in chunks; a bulk callable fills one chunk per call.
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, std::span<Uuid>)> fill);
+
+    // func is either per element, Uuid(size_t index), or bulk,
+    // void(size_t first, std::span<Uuid> out) filling out[i] for first + i.
+    // The per-element form is wrapped in a loop here, so it can be inlined.
+    template<class F>
+        requires (std::is_invocable_v<F&, size_t, std::span<Uuid>> || std::is_invocable_r_v<Uuid, F&, size_t>)
+    void process_with_callable_range(size_t first, size_t count, F&& func)
+    {
+        if constexpr (std::is_invocable_v<F&, size_t, std::span<Uuid>>) {
+            process_with_callable_range(first, count, FunctionRef<void (size_t, std::span<Uuid>)>(func));
+        } else {
+            auto fill = [&func](size_t base, std::span<Uuid> out) {
+                for (size_t i = 0; i < out.size(); i++)
+                    out[i] = func(base + i);
+            };
+            process_with_callable_range(first, count, FunctionRef<void (size_t, std::span<Uuid>)>(fill));
+        }
+    }
+
+    // Number of counter values handed out so far, summed over all shards.
+    size_t total_processed() const;
+    // All zero unless the handle was opened with a queue.
+    QueueStats queue_stats() const;
+    // Merges the per-thread buckets; all zero unless opened with metrics.
+    Stats stats() const;
+    // All zero unless a cache was inserted; see Options::cache_capacity.
+    CacheStats cache_stats() const;
+    unsigned capabilities() const;
+
+    // exporter must stay valid until replaced; null removes it.
+    static void set_stats_exporter(StatsExporter* exporter);
+    // Sends a snapshot of every live instrumented Impl to the exporter.
+    static void export_stats();
 
     static void force_inst();
 private:
-    std::string open_fail_desc;
-    std::shared_ptr<Impl> pImpl;
+    template<class ImplT> friend class BasicTransport;
+    friend class TransportRef;
+
+    Transport(TransportError error, IntrusivePtr<Impl> impl) : open_err(error), pImpl(std::move(impl)) {}
+
+    Impl& checked_impl() const
+    {
+        if (!pImpl)
+            throw_transport_closed(open_err);
+        return *pImpl;
+    }
+
+    // Declared first: the constructors' open_impl() call sets it.
+    TransportError open_err = TransportError::none;
+    IntrusivePtr<Impl> pImpl;
 };
 
+// Per-session state for Impl::feed and Impl::drain. Impls that stream derive
+// their own state from it; pending holds output not yet drained, from pos on,
+// and input is where the default feed collects the argument.
+struct Transport::StreamState {
+    virtual ~StreamState() = default;
+
+    // Unread output TransportStream::write allows below any chunk size.
+    static constexpr size_t min_window = 4096;
+
+    std::string pending;
+    size_t pos = 0;
+    std::string input;
+    bool input_done = false;
+
+    size_t unread() const { return pending.size() - pos; }
+
+    // Moves up to out.size() bytes of pending output into out. The consumed
+    // prefix is dropped once it is at least half of pending, so the buffer
+    // stays near the unread size and each byte is moved at most once more.
+    size_t take(std::span<char> out)
+    {
+        size_t n = std::min(out.size(), unread());
+        pending.copy(out.data(), n, pos);
+        pos += n;
+        if (pos == pending.size()) {
+            pending.clear();
+            pos = 0;
+        } else if (pos >= pending.size() - pos) {
+            pending.erase(0, pos);
+            pos = 0;
+        }
+        return n;
+    }
+
+    bool output_done() const { return input_done && unread() == 0; }
+};
+
+// Copies of a Transport share one Impl and may be used from different threads
+// at once, so every Impl must be safe for concurrent calls.
 struct Transport::Impl {
-    virtual std::string process(const std::string& arg) = 0;
-    virtual void process_with_callable(std::function<Transport::Uuid (size_t)> func) = 0;
-};
\ No newline at end of file
+    Impl() = default;
+    Impl(const Impl&) = delete;
+    Impl& operator=(const Impl&) = delete;
+    virtual ~Impl() = default;
+
+    // Embedded refcount used by IntrusivePtr. A new Impl starts at zero.
+    void retain() const noexcept
+    {
+        if (confined)
+            refs.store(refs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() const noexcept
+    {
+        size_t before;
+        if (confined) {
+            before = refs.load(std::memory_order_relaxed);
+            refs.store(before - 1, std::memory_order_relaxed);
+        } else {
+            before = refs.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        if (before == 1)
+            const_cast<Impl*>(this)->destroy();
+    }
+
+    // Takes a reference only if the Impl is still alive; for lookups that
+    // found the Impl without owning a reference to it.
+    bool try_retain() const noexcept
+    {
+        size_t n = refs.load(std::memory_order_relaxed);
+        do {
+            if (n == 0)
+                return false;
+        } while (!refs.compare_exchange_weak(n, n + 1, std::memory_order_relaxed));
+        return true;
+    }
+
+    size_t ref_count() const noexcept { return refs.load(std::memory_order_relaxed); }
+
+    // See Options::thread_confined; set before the first copy is made.
+    void confine_to_thread() noexcept { confined = true; }
+    bool is_confined() const noexcept { return confined; }
+
+    // Runs when the last reference goes away; override to free the Impl
+    // somewhere other than the global heap.
+    virtual void destroy() noexcept { delete this; }
+
+    virtual std::string process(std::string_view arg) = 0;
+    // process() on an argument the Impl may reuse as the result's buffer.
+    // The default just calls process().
+    virtual std::string process_owned(std::string&& arg) { return process(std::string_view(arg)); }
+    // Formats into out, reusing its capacity; out is overwritten, not appended to.
+    virtual void process_into(std::string_view arg, std::string& out) = 0;
+    // The default goes through a heap string; override to format in place.
+    virtual void process_into(std::string_view arg, std::pmr::string& out)
+    {
+        std::string tmp;
+        process_into(arg, tmp);
+        out.assign(tmp);
+    }
+    // out is resized to args.size(); out[i] gets the result for args[i], with
+    // counter values assigned as one contiguous range in argument order.
+    virtual void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out) = 0;
+    // Parts may reference in and the Impl's own storage; callers keep both
+    // alive while they use out. The default joins in, calls process() and
+    // copies the result into out.
+    virtual void process_fragments(std::span<const std::string_view> in, TransportFragments& out)
+    {
+        std::string arg;
+        for (std::string_view part : in)
+            arg.append(part);
+        out.clear();
+        out.append_copy(process(arg));
+    }
+    virtual void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) = 0;
+    virtual void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, std::span<Transport::Uuid>)> fill) = 0;
+    virtual size_t total_processed() const = 0;
+    virtual Transport::QueueStats queue_stats() const { return {}; }
+    virtual Transport::Stats stats() const { return {}; }
+    virtual Transport::CacheStats cache_stats() const { return {}; }
+    // A combination of Transport::idempotent and future capability bits.
+    virtual unsigned capabilities() const { return 0; }
+    // Only a lazy layer has an open still to do; see Options::lazy.
+    virtual bool warm() { return true; }
+    virtual TransportError deferred_error() const { return TransportError::none; }
+
+    // Streaming: stream_open makes the session state, feed takes the next
+    // chunk of the argument (last on the final one), and drain moves out
+    // whatever output is ready. A session is only used by one thread at a
+    // time. These defaults collect the whole argument and call process() at
+    // the end; override them to stream in bounded memory.
+    virtual std::unique_ptr<Transport::StreamState> stream_open() { return std::make_unique<Transport::StreamState>(); }
+
+    virtual void feed(Transport::StreamState& s, std::string_view chunk, bool last)
+    {
+        s.input.append(chunk);
+        if (last) {
+            s.pending = process(s.input);
+            s.input = std::string();
+            s.input_done = true;
+        }
+    }
+
+    virtual size_t drain(Transport::StreamState& s, std::span<char> out)
+    {
+        if (!s.input_done)
+            return 0;
+        return s.take(out);
+    }
+
+private:
+    mutable std::atomic<size_t> refs{0};
+    bool confined = false;
+};
+
+class TransportRef {
+public:
+    bool is_same(const TransportRef& other) const { return impl == other.impl; }
+
+    std::string process(std::string_view arg) { return impl->process(arg); }
+    std::string process(const std::string& arg) { return impl->process(arg); }
+    std::string process(const char* arg) { return impl->process(arg); }
+    std::string process(std::string&& arg) { return impl->process_owned(std::move(arg)); }
+    void process_into(std::string_view arg, std::string& out) { impl->process_into(arg, out); }
+    void process_into(std::string_view arg, std::pmr::string& out) { impl->process_into(arg, out); }
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out) { impl->process_batch(args, out); }
+    void process_fragments(std::span<const std::string_view> in, TransportFragments& out) { impl->process_fragments(in, out); }
+
+    template<class F>
+        requires std::is_invocable_r_v<Transport::Uuid, F&, size_t>
+    void process_with_callable(F&& func) { impl->process_with_callable(FunctionRef<Transport::Uuid (size_t)>(func)); }
+
+    size_t total_processed() const { return impl->total_processed(); }
+
+    // Takes a new owning reference.
+    Transport to_transport() const { return Transport(TransportError::none, IntrusivePtr<Transport::Impl>(impl)); }
+
+private:
+    friend class Transport;
+    explicit TransportRef(Transport::Impl* impl) : impl(impl) {}
+
+    Transport::Impl* impl;
+};
+
+// One streaming call, from Transport::open_stream(). write() refuses a chunk
+// while more than one chunk of output is unread, so an Impl that streams
+// holds about two chunks whatever the payload size, and output can be
+// consumed before the input is complete. Not safe for concurrent use; the
+// session keeps the Impl alive.
+class TransportStream {
+public:
+    TransportStream(TransportStream&&) = default;
+    TransportStream& operator=(TransportStream&&) = default;
+
+    // Hands the next piece of the argument to the Impl and returns true.
+    // While more unread output is pending than this chunk (or
+    // StreamState::min_window, if larger), it takes nothing and returns
+    // false; read() and write the chunk again.
+    [[nodiscard]] bool write(std::string_view chunk)
+    {
+        check_writable();
+        if (state->unread() > std::max(chunk.size(), Transport::StreamState::min_window))
+            return false;
+        impl->feed(*state, chunk, false);
+        return true;
+    }
+
+    // Ends the argument; chunk, if given, is its last piece. Never refused,
+    // as nothing follows it.
+    void finish(std::string_view chunk = {})
+    {
+        check_writable();
+        impl->feed(*state, chunk, true);
+    }
+
+    // Moves up to out.size() bytes of ready output into out and returns how
+    // many; 0 means nothing is ready yet, or done().
+    size_t read(std::span<char> out) { return impl->drain(*state, out); }
+
+    // True once finish() was called and every byte of output was read.
+    bool done() const { return state->output_done(); }
+
+private:
+    friend class Transport;
+    TransportStream(IntrusivePtr<Transport::Impl> impl, std::unique_ptr<Transport::StreamState> state)
+        : impl(std::move(impl)), state(std::move(state)) {}
+
+    void check_writable() const;
+
+    IntrusivePtr<Transport::Impl> impl;
+    std::unique_ptr<Transport::StreamState> state;
+};
+
+static_assert(std::is_nothrow_move_constructible_v<Transport> && std::is_nothrow_move_assignable_v<Transport>);
+
+inline bool Transport::is_open() const
+{
+    return pImpl && pImpl->deferred_error() == TransportError::none;
+}
+
+inline TransportError Transport::error() const
+{
+    if (open_err == TransportError::none && pImpl)
+        return pImpl->deferred_error();
+    return open_err;
+}
+
+inline size_t Transport::use_count() const
+{
+    if (pImpl)
+        return pImpl->ref_count();
+    return 0;
+}
+
+inline TransportRef Transport::borrow() const
+{
+    return TransportRef(&checked_impl());
+}
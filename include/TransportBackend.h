@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Transport.h"
+
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+// Returns null and sets error when the open fails. resource is null for heap
+// allocation; a factory may ignore it.
+typedef IntrusivePtr<Transport::Impl> (*TransportFactory)(TransportError& error, std::string_view name, const Transport::Options& opts,
+                                                          std::pmr::memory_resource* resource);
+
+// A backend serves every Transport name of the form "scheme://rest"; its
+// factory receives "rest". Names without a scheme go to the built-in
+// TransportImpl_factory.
+struct TransportBackend {
+    const char* scheme;
+    TransportFactory factory;
+    // Optional; run once at load so first calls don't pay for cold pages.
+    void (*warm)();
+};
+
+// Loadable backend libraries export this, returning a descriptor that lives
+// as long as the library.
+extern "C" const TransportBackend* transport_backend();
+#define TRANSPORT_BACKEND_SYMBOL "transport_backend"
+
+struct TransportBackends {
+    // Registers an in-process backend; fails if the scheme is taken.
+    static bool add(const TransportBackend& backend);
+
+    // dlopens path with RTLD_NOW, so its symbols are bound up front, then
+    // registers and warms its backend. Libraries stay loaded for the life of
+    // the process.
+    static bool load(const std::string& path, std::string& error);
+
+    // Loads every library in the colon-separated TRANSPORT_BACKENDS
+    // environment variable. Runs automatically before the first scheme lookup.
+    static void load_env();
+
+    // Returns the factory for name and points rest at the part it receives;
+    // nullptr for an unknown scheme. Results are cached per thread.
+    static TransportFactory find(std::string_view name, std::string_view& rest);
+};
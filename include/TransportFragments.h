@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A result as a list of pieces, in order, for writev/sendmsg-style output.
+// Parts may point into the call's input fragments, into memory owned by the
+// Impl (valid while a handle to it is held), or into this object; clear()
+// and the next call reuse the list's capacity. Not copyable, since parts can
+// point into the object itself.
+class TransportFragments {
+public:
+    TransportFragments() = default;
+    TransportFragments(const TransportFragments&) = delete;
+    TransportFragments& operator=(const TransportFragments&) = delete;
+
+    std::span<const std::string_view> parts() const { return list; }
+
+    // Total length in bytes.
+    size_t size() const
+    {
+        size_t n = 0;
+        for (std::string_view part : list)
+            n += part.size();
+        return n;
+    }
+
+    std::string str() const
+    {
+        std::string out;
+        out.reserve(size());
+        for (std::string_view part : list)
+            out.append(part);
+        return out;
+    }
+
+    void clear()
+    {
+        list.clear();
+        local_used = 0;
+        spill.clear();
+    }
+
+    // Adds a part that outlives this list's use, without copying it.
+    void append(std::string_view part)
+    {
+        if (!part.empty())
+            list.push_back(part);
+    }
+
+    // Adds a copy of text, stored in this object. Short text goes into an
+    // inline buffer; the rest gets its own string, which never moves.
+    void append_copy(std::string_view text)
+    {
+        if (text.size() <= sizeof(local) - local_used) {
+            char* at = local + local_used;
+            text.copy(at, text.size());
+            local_used += text.size();
+            append(std::string_view(at, text.size()));
+        } else {
+            append(spill.emplace_back(text));
+        }
+    }
+
+private:
+    std::vector<std::string_view> list;
+    char local[64];
+    size_t local_used = 0;
+    std::deque<std::string> spill;
+};
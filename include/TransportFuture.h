@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Shared completion state of one asynchronous call. The producer completes it
+// exactly once. Blocked get() callers wake through an atomic wait, and an
+// awaiting coroutine is resumed inline by the completing thread, so there is
+// no mutex or condition variable handoff.
+template<class T>
+struct FutureState {
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::atomic<std::uint32_t> ready{0};
+    std::atomic<void*> continuation{nullptr};
+
+    void set_value(T v)
+    {
+        value.emplace(std::move(v));
+        complete();
+    }
+
+    void set_exception(std::exception_ptr e)
+    {
+        error = std::move(e);
+        complete();
+    }
+
+    static void* done() { return reinterpret_cast<void*>(std::uintptr_t(1)); }
+
+private:
+    void complete()
+    {
+        ready.store(1, std::memory_order_release);
+        ready.notify_all();
+        void* waiter = continuation.exchange(done(), std::memory_order_acq_rel);
+        if (waiter)
+            std::coroutine_handle<>::from_address(waiter).resume();
+    }
+};
+
+// Result of Transport::process_async. Either call get(), which blocks until
+// the value is ready, or co_await it from a coroutine, which then resumes on
+// the worker thread that produced the value. Use one or the other, once.
+template<class T>
+class TransportFuture {
+public:
+    TransportFuture() = default;
+    explicit TransportFuture(std::shared_ptr<FutureState<T>> state) : state(std::move(state)) {}
+
+    bool valid() const { return state != nullptr; }
+    bool ready() const { return state->ready.load(std::memory_order_acquire) != 0; }
+
+    void wait() const
+    {
+        while (!ready())
+            state->ready.wait(0, std::memory_order_acquire);
+    }
+
+    T get()
+    {
+        wait();
+        return take();
+    }
+
+    bool await_ready() const { return ready(); }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        void* expected = nullptr;
+        return state->continuation.compare_exchange_strong(expected, h.address(), std::memory_order_acq_rel);
+    }
+
+    T await_resume() { return take(); }
+
+private:
+    T take()
+    {
+        auto s = std::move(state);
+        if (s->error)
+            std::rethrow_exception(s->error);
+        return std::move(*s->value);
+    }
+
+    std::shared_ptr<FutureState<T>> state;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Uuid128.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel : unsigned char { trace, debug, info, warn, error, off };
+
+// Statements below this level are compiled out entirely.
+#ifndef TRANSPORT_LOG_LEVEL
+#define TRANSPORT_LOG_LEVEL 1
+#endif
+
+// Takes an int, not a LogLevel: compared directly, an unsigned char level
+// against TRANSPORT_LOG_LEVEL=0 trips -Wtype-limits.
+constexpr bool log_compiled_in(int level)
+{
+    return level >= TRANSPORT_LOG_LEVEL;
+}
+
+// One raw log argument. Values are captured, not formatted; strings longer
+// than the inline buffer are truncated.
+struct LogArg {
+    enum Kind : unsigned char { none, u64, i64, str, uuid };
+
+    Kind kind = none;
+    unsigned char len = 0;
+    union {
+        std::uint64_t u;
+        std::int64_t i;
+        Uuid128 id;
+        char s[38];
+    };
+
+    LogArg() : u(0) {}
+    template<class T>
+        requires std::is_integral_v<T> && std::is_unsigned_v<T>
+    LogArg(T v) : kind(u64), u(std::uint64_t(v)) {}
+    template<class T>
+        requires std::is_integral_v<T> && std::is_signed_v<T>
+    LogArg(T v) : kind(i64), i(std::int64_t(v)) {}
+    LogArg(const Uuid128& v) : kind(uuid), id(v) {}
+    LogArg(std::string_view v) : kind(str)
+    {
+        len = v.size() < sizeof(s) ? (unsigned char)v.size() : sizeof(s);
+        v.copy(s, len);
+    }
+    // Any allocator, so std::pmr::string works too.
+    template<class Alloc>
+    LogArg(const std::basic_string<char, std::char_traits<char>, Alloc>& v) : LogArg(std::string_view(v)) {}
+    LogArg(const char* v) : LogArg(std::string_view(v)) {}
+};
+
+// where, file and msg must have static storage duration; msg uses "{}" for
+// each argument in order.
+struct LogRecord {
+    static constexpr size_t max_args = 3;
+
+    LogLevel level;
+    const char* where;
+    const char* file;
+    const char* msg;
+    unsigned char nargs;
+    LogArg args[max_args];
+};
+
+// Appends "where file msg" with the arguments substituted.
+void format_log_record(const LogRecord& rec, std::string& out);
+
+struct LogSink {
+    virtual ~LogSink() = default;
+    virtual void write(const LogRecord& rec) = 0;
+};
+
+// The sink is not owned and must stay alive until it is replaced; nullptr,
+// the default, drops every record.
+void set_log_sink(LogSink* sink);
+void set_log_level(LogLevel level);
+bool log_enabled(LogLevel level);
+void log_write(LogLevel level, const char* where, const char* file, const char* msg, std::initializer_list<LogArg> args);
+
+// Formats and writes synchronously, one line per record, without flushing.
+class StreamLogSink : public LogSink {
+public:
+    explicit StreamLogSink(std::ostream& os);
+    ~StreamLogSink();
+    void write(const LogRecord& rec) override;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+// Copies records into a bounded lock-free ring and hands them to backend on
+// a background thread, which is where formatting happens. A full ring drops
+// the record rather than blocking the caller.
+class AsyncLogSink : public LogSink {
+public:
+    explicit AsyncLogSink(LogSink& backend, size_t capacity = 1024);
+    ~AsyncLogSink();
+    void write(const LogRecord& rec) override;
+
+    // Waits until every record accepted so far reached the backend.
+    void flush();
+    size_t dropped() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+#define TRANSPORT_LOG(level, msg, ...) \
+    do { \
+        if constexpr (log_compiled_in(int(LogLevel::level))) { \
+            if (log_enabled(LogLevel::level)) \
+                log_write(LogLevel::level, __PRETTY_FUNCTION__, __FILE__, msg, { __VA_ARGS__ }); \
+        } \
+    } while (0)
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Binary traffic log written by Options::recorder and read by
+// transport_replay. The file starts with transport_record_magic, followed
+// by records: a TransportRecordHeader, then the name, argument and result
+// bytes, then zero padding to a multiple of 8 so every header stays
+// aligned. Fields are in host byte order.
+inline constexpr char transport_record_magic[8] = { 'T', 'R', 'N', 'S', 'L', 'O', 'G', '2' };
+
+struct TransportRecordHeader {
+    std::uint32_t name_len;
+    std::uint32_t arg_len;
+    std::uint32_t result_len;
+    std::uint32_t reserved;
+    // Position of the record in the log.
+    std::uint64_t seq;
+    // Call start, in nanoseconds since the recorder was created.
+    std::uint64_t start_ns;
+    std::uint64_t duration_ns;
+    // The Impl's total_processed() right after the call; for a batch, the
+    // value as of this element when the counter moved once per element,
+    // else the total after the batch. Only matches a replay when the
+    // recorded handle was used from one thread, made no unrecorded calls
+    // and had no cache (hits leave the counter alone).
+    std::uint64_t processed;
+
+    std::uint64_t payload_size() const { return (std::uint64_t(name_len) + arg_len + result_len + 7) & ~std::uint64_t(7); }
+};
+
+static_assert(sizeof(TransportRecordHeader) == 48);
+
+// Appends records to a log file. Safe to share between handles and threads;
+// appends are serialized and buffered, and reach the file on flush() or
+// destruction.
+class TransportRecorder {
+public:
+    // Creates or truncates path; check is_open().
+    explicit TransportRecorder(const std::string& path);
+    ~TransportRecorder();
+
+    bool is_open() const;
+    // Nanoseconds since the recorder was created.
+    std::uint64_t now_ns() const;
+    void append(std::string_view name, std::string_view arg, std::string_view result, std::uint64_t start_ns, std::uint64_t duration_ns,
+                std::uint64_t processed);
+    void flush();
+    std::uint64_t records() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+// Begin/end spans around Transport calls, for lining them up with other
+// work in a trace viewer. Built only with -DTRANSPORT_TRACE=1 (the CMake
+// option of the same name); otherwise TRANSPORT_TRACE_SCOPE expands to
+// nothing and its arguments are never evaluated.
+#ifndef TRANSPORT_TRACE
+#define TRANSPORT_TRACE 0
+#endif
+
+struct TraceSink {
+    virtual ~TraceSink() = default;
+    // name has static storage duration; phase is 'B' or 'E', or 'i' for an
+    // instant event. handle identifies the Impl, arg_size is the argument's
+    // size in bytes (or elements, for ranges) and is 0 on end events.
+    virtual void event(const char* name, char phase, std::uint64_t handle, std::uint64_t arg_size) = 0;
+};
+
+// The sink is not owned and must outlive every span started while it was
+// installed; nullptr, the default, drops every event.
+void set_trace_sink(TraceSink* sink);
+TraceSink* trace_sink();
+
+// Emits the begin event now and the end event on scope exit, both to the
+// sink that was current at the start.
+class TraceScope {
+public:
+    TraceScope(const char* name, const void* handle, std::uint64_t arg_size)
+        : sink(trace_sink()), name(name), handle(reinterpret_cast<std::uintptr_t>(handle))
+    {
+        if (sink)
+            sink->event(name, 'B', this->handle, arg_size);
+    }
+
+    ~TraceScope()
+    {
+        if (sink)
+            sink->event(name, 'E', handle, 0);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceSink* sink;
+    const char* name;
+    std::uint64_t handle;
+};
+
+// Emits a single instant event to the current sink.
+inline void trace_instant(const char* name, const void* handle, std::uint64_t arg_size)
+{
+    if (TraceSink* sink = trace_sink())
+        sink->event(name, 'i', reinterpret_cast<std::uintptr_t>(handle), arg_size);
+}
+
+// Writes Chrome trace-event JSON, which Perfetto and chrome://tracing load.
+// Each thread records into its own lock-free single-producer ring; a
+// background thread drains the rings every few milliseconds and writes to
+// os. A full ring drops the event. The closing bracket is written by the
+// destructor, so the output is only complete once the sink is gone.
+class ChromeTraceSink : public TraceSink {
+public:
+    explicit ChromeTraceSink(std::ostream& os, size_t per_thread_capacity = 4096);
+    ~ChromeTraceSink();
+    void event(const char* name, char phase, std::uint64_t handle, std::uint64_t arg_size) override;
+
+    // Writes every event recorded so far, from the calling thread.
+    void flush();
+    size_t dropped() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+#if TRANSPORT_TRACE
+#define TRANSPORT_TRACE_CONCAT2(a, b) a##b
+#define TRANSPORT_TRACE_CONCAT(a, b) TRANSPORT_TRACE_CONCAT2(a, b)
+#define TRANSPORT_TRACE_SCOPE(name, handle, arg_size) \
+    TraceScope TRANSPORT_TRACE_CONCAT(trace_scope_, __LINE__)(name, handle, arg_size)
+#define TRANSPORT_TRACE_INSTANT(name, handle, arg_size) trace_instant(name, handle, arg_size)
+#else
+#define TRANSPORT_TRACE_SCOPE(name, handle, arg_size) do {} while (0)
+#define TRANSPORT_TRACE_INSTANT(name, handle, arg_size) do {} while (0)
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 16-byte, trivially copyable UUID. The text form is the canonical
+// 8-4-4-4-12 lowercase hex layout. format() and parse() walk fixed offset
+// tables with no data-dependent branches, which lets the compiler unroll and
+// vectorize them.
+struct Uuid128 {
+    std::array<std::uint8_t, 16> bytes{};
+
+    static constexpr size_t text_size = 36;
+
+    // hi and lo are stored big-endian, so hi() and lo() read them back.
+    static constexpr Uuid128 from_u64(std::uint64_t hi, std::uint64_t lo)
+    {
+        Uuid128 u;
+        for (int i = 0; i < 8; i++) {
+            u.bytes[i] = std::uint8_t(hi >> (56 - 8 * i));
+            u.bytes[8 + i] = std::uint8_t(lo >> (56 - 8 * i));
+        }
+        return u;
+    }
+
+    constexpr std::uint64_t hi() const { return load(0); }
+    constexpr std::uint64_t lo() const { return load(8); }
+
+    // Writes exactly text_size characters, no terminator.
+    void format(char* out) const
+    {
+        constexpr char digits[] = "0123456789abcdef";
+        for (size_t i = 0; i < 16; i++) {
+            out[text_pos[i]] = digits[bytes[i] >> 4];
+            out[text_pos[i] + 1] = digits[bytes[i] & 0xf];
+        }
+        out[8] = out[13] = out[18] = out[23] = '-';
+    }
+
+    std::string to_string() const
+    {
+        std::string s(text_size, '\0');
+        format(s.data());
+        return s;
+    }
+
+    // Accepts upper or lower case hex; anything else yields nullopt.
+    static std::optional<Uuid128> parse(std::string_view text)
+    {
+        if (text.size() != text_size)
+            return std::nullopt;
+
+        Uuid128 u;
+        std::uint8_t bad = (text[8] ^ '-') | (text[13] ^ '-') | (text[18] ^ '-') | (text[23] ^ '-');
+        for (size_t i = 0; i < 16; i++) {
+            std::uint8_t h = hex_value[std::uint8_t(text[text_pos[i]])];
+            std::uint8_t l = hex_value[std::uint8_t(text[text_pos[i] + 1])];
+            bad |= (h | l) & 0x10;
+            u.bytes[i] = std::uint8_t(h << 4 | (l & 0xf));
+        }
+        if (bad)
+            return std::nullopt;
+        return u;
+    }
+
+    friend constexpr auto operator<=>(const Uuid128&, const Uuid128&) = default;
+
+private:
+    static constexpr std::uint8_t text_pos[16] = { 0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34 };
+
+    // Hex digit value, or 0x10 for characters that are not hex digits.
+    static constexpr std::array<std::uint8_t, 256> hex_value = [] {
+        std::array<std::uint8_t, 256> t{};
+        for (int c = 0; c < 256; c++)
+            t[c] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 0x10;
+        return t;
+    }();
+
+    constexpr std::uint64_t load(size_t at) const
+    {
+        std::uint64_t v = 0;
+        for (size_t i = 0; i < 8; i++)
+            v = v << 8 | bytes[at + i];
+        return v;
+    }
+};
+
+static_assert(sizeof(Uuid128) == 16 && std::is_trivially_copyable_v<Uuid128>);
+
+inline std::ostream& operator<<(std::ostream& os, const Uuid128& u)
+{
+    char text[Uuid128::text_size];
+    u.format(text);
+    return os.write(text, sizeof(text));
+}
+
+template<>
+struct std::hash<Uuid128> {
+    size_t operator()(const Uuid128& u) const noexcept
+    {
+        std::uint64_t a, b;
+        std::memcpy(&a, u.bytes.data(), 8);
+        std::memcpy(&b, u.bytes.data() + 8, 8);
+        std::uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+        return size_t(h ^ (h >> 32));
+    }
+};
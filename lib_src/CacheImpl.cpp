@@ -0,0 +1,190 @@
+#include "ImplLayers.h"
+#include "ThreadShard.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Memoizes an idempotent Impl by argument. Keys hash to one of shard_count
+// shards; each is a fixed ring of slots replaced in CLOCK order, with an
+// index from key to slot. Hits take the shard's lock shared and only set the
+// slot's reference bit, so concurrent readers don't exclude each other;
+// misses call the inner Impl outside any lock and then insert exclusively.
+struct CacheImpl : public ForwardingImpl {
+    static constexpr size_t shard_count = 16;
+    static constexpr size_t counter_shards = 16;
+
+    struct Slot {
+        // The index keys are views of this string, which never moves.
+        string key;
+        string value;
+        atomic<bool> referenced{false};
+        bool used = false;
+    };
+
+    struct alignas(64) Shard {
+        mutable shared_mutex lock;
+        vector<Slot> slots;
+        unordered_map<string_view, size_t> index;
+        size_t hand = 0;
+
+        explicit Shard(size_t capacity) : slots(capacity) { index.reserve(capacity); }
+    };
+
+    // Written by one thread each (up to counter_shards threads), summed on read.
+    struct alignas(64) Counters {
+        atomic<size_t> hits{0};
+        atomic<size_t> misses{0};
+        atomic<size_t> evictions{0};
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    unique_ptr<Counters[]> counters;
+    size_t capacity;
+
+    CacheImpl(IntrusivePtr<Transport::Impl> inner, size_t total)
+        : ForwardingImpl(move(inner)), counters(make_unique<Counters[]>(counter_shards))
+    {
+        size_t per_shard = (total + shard_count - 1) / shard_count;
+        capacity = per_shard * shard_count;
+        for (size_t i = 0; i < shard_count; i++)
+            shards.push_back(make_unique<Shard>(per_shard));
+    }
+
+    Counters& counter() { return counters[thread_shard_index() % counter_shards]; }
+
+    Shard& shard_for(string_view key) { return *shards[hash<string_view>()(key) % shard_count]; }
+
+    template<class String>
+    bool lookup(string_view arg, String& out)
+    {
+        Shard& s = shard_for(arg);
+        {
+            shared_lock<shared_mutex> guard(s.lock);
+            auto it = s.index.find(arg);
+            if (it != s.index.end()) {
+                Slot& slot = s.slots[it->second];
+                slot.referenced.store(true, memory_order_relaxed);
+                out.assign(slot.value);
+                counter().hits.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+        }
+        counter().misses.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    void insert(string_view arg, string_view value)
+    {
+        Shard& s = shard_for(arg);
+        unique_lock<shared_mutex> guard(s.lock);
+        if (s.index.count(arg))
+            return;
+
+        // Second chance: skip, and clear, slots read since the hand last passed.
+        for (;;) {
+            Slot& slot = s.slots[s.hand];
+            if (slot.used && slot.referenced.exchange(false, memory_order_relaxed)) {
+                s.hand = (s.hand + 1) % s.slots.size();
+                continue;
+            }
+            break;
+        }
+
+        size_t victim = s.hand;
+        s.hand = (s.hand + 1) % s.slots.size();
+        Slot& slot = s.slots[victim];
+        if (slot.used) {
+            s.index.erase(slot.key);
+            counter().evictions.fetch_add(1, memory_order_relaxed);
+        }
+        slot.key.assign(arg);
+        slot.value.assign(value);
+        slot.used = true;
+        s.index.emplace(slot.key, victim);
+    }
+
+    string process(string_view arg) override
+    {
+        string out;
+        process_into(arg, out);
+        return out;
+    }
+
+    // The argument is kept as the key, so it can't become the result.
+    string process_owned(string&& arg) override { return process(string_view(arg)); }
+
+    void process_into(string_view arg, string& out) override
+    {
+        if (lookup(arg, out))
+            return;
+        inner->process_into(arg, out);
+        insert(arg, out);
+    }
+
+    void process_into(string_view arg, pmr::string& out) override
+    {
+        if (lookup(arg, out))
+            return;
+        inner->process_into(arg, out);
+        insert(arg, out);
+    }
+
+    // Misses go to the inner Impl as one smaller batch.
+    void process_batch(span<const string_view> args, vector<string>& out) override
+    {
+        out.resize(args.size());
+        vector<size_t> missed;
+        vector<string_view> miss_args;
+        for (size_t i = 0; i < args.size(); i++) {
+            if (!lookup(args[i], out[i])) {
+                missed.push_back(i);
+                miss_args.push_back(args[i]);
+            }
+        }
+        if (missed.empty())
+            return;
+
+        vector<string> results;
+        inner->process_batch(miss_args, results);
+        for (size_t j = 0; j < missed.size() && j < results.size(); j++) {
+            insert(miss_args[j], results[j]);
+            out[missed[j]] = move(results[j]);
+        }
+    }
+
+    // Joined and answered through process(), so fragments hit the cache too.
+    void process_fragments(span<const string_view> in, TransportFragments& out) override
+    {
+        Transport::Impl::process_fragments(in, out);
+    }
+
+    Transport::CacheStats cache_stats() const override
+    {
+        Transport::CacheStats stats;
+        for (size_t i = 0; i < counter_shards; i++) {
+            stats.hits += counters[i].hits.load(memory_order_relaxed);
+            stats.misses += counters[i].misses.load(memory_order_relaxed);
+            stats.evictions += counters[i].evictions.load(memory_order_relaxed);
+        }
+        for (auto& s : shards) {
+            shared_lock<shared_mutex> guard(s->lock);
+            stats.size += s->index.size();
+        }
+        stats.capacity = capacity;
+        return stats;
+    }
+};
+
+}
+
+IntrusivePtr<Transport::Impl> make_cache_impl(IntrusivePtr<Transport::Impl> inner, size_t capacity)
+{
+    return make_intrusive<CacheImpl>(move(inner), capacity);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+// CPUs grouped by NUMA node, read once from sysfs. Nodes are numbered
+// densely in the order the kernel lists them. Without the node directory
+// (not Linux, or no NUMA support) the machine is one node holding every CPU.
+struct CpuTopology {
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<size_t> cpu_node;
+
+    size_t nodes() const { return node_cpus.size(); }
+
+    // Node of the CPU the caller is on right now; threads can migrate, so
+    // this is a hint for locality, not a guarantee.
+    size_t current_node() const
+    {
+        int cpu = sched_getcpu();
+        if (cpu < 0 || size_t(cpu) >= cpu_node.size())
+            return 0;
+        return cpu_node[cpu];
+    }
+
+    // Every CPU, node by node.
+    std::vector<int> all_cpus() const
+    {
+        std::vector<int> cpus;
+        for (auto& node : node_cpus)
+            cpus.insert(cpus.end(), node.begin(), node.end());
+        return cpus;
+    }
+
+    // Parses a kernel cpulist such as "0-3,8-11".
+    static std::vector<int> parse_cpulist(const std::string& list)
+    {
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string range = list.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+                int first = std::atoi(range.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+                for (int cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            }
+            pos = end + 1;
+        }
+        return cpus;
+    }
+
+    static CpuTopology read()
+    {
+        CpuTopology topo;
+        int max_cpu = -1;
+        // Node ids can have holes; stop after a run of missing ones.
+        for (int id = 0, missing = 0; missing < 64; id++) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string list;
+            if (!in || !std::getline(in, list)) {
+                missing++;
+                continue;
+            }
+            missing = 0;
+            auto cpus = parse_cpulist(list);
+            if (cpus.empty())
+                continue;
+            for (int cpu : cpus)
+                max_cpu = std::max(max_cpu, cpu);
+            topo.node_cpus.push_back(std::move(cpus));
+        }
+        if (topo.node_cpus.empty()) {
+            std::vector<int> cpus;
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+                cpus.push_back(int(cpu));
+            max_cpu = int(cpus.size()) - 1;
+            topo.node_cpus.push_back(std::move(cpus));
+        }
+        topo.cpu_node.assign(size_t(max_cpu + 1), 0);
+        for (size_t node = 0; node < topo.node_cpus.size(); node++)
+            for (int cpu : topo.node_cpus[node])
+                topo.cpu_node[cpu] = node;
+        return topo;
+    }
+};
+
+// Never destroyed, like the other process-wide tables.
+inline const CpuTopology& cpu_topology()
+{
+    static const CpuTopology* topo = new CpuTopology(CpuTopology::read());
+    return *topo;
+}
+
+// Restricts the calling thread to cpus; threads it starts afterwards inherit
+// the mask. Returns false if the kernel refused, e.g. for CPUs outside the
+// process's cpuset.
+inline bool pin_current_thread(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Transport.h"
+
+#include <memory>
+#include <utility>
+
+// Front-end layers that wrap a backend Impl to add behaviour selected by
+// Transport::Options. Each layer derives from ForwardingImpl and overrides
+// only the calls it changes.
+struct ForwardingImpl : public Transport::Impl {
+    IntrusivePtr<Transport::Impl> inner;
+
+    explicit ForwardingImpl(IntrusivePtr<Transport::Impl> inner) : inner(std::move(inner)) {}
+
+    std::string process(std::string_view arg) override { return inner->process(arg); }
+    std::string process_owned(std::string&& arg) override { return inner->process_owned(std::move(arg)); }
+    void process_into(std::string_view arg, std::string& out) override { inner->process_into(arg, out); }
+    void process_into(std::string_view arg, std::pmr::string& out) override { inner->process_into(arg, out); }
+    void process_batch(std::span<const std::string_view> args, std::vector<std::string>& out) override { inner->process_batch(args, out); }
+    void process_fragments(std::span<const std::string_view> in, TransportFragments& out) override { inner->process_fragments(in, out); }
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override { inner->process_with_callable(func); }
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, std::span<Transport::Uuid>)> fill) override
+    {
+        inner->process_with_callable_range(first, count, fill);
+    }
+    size_t total_processed() const override { return inner->total_processed(); }
+    Transport::QueueStats queue_stats() const override { return inner->queue_stats(); }
+    Transport::Stats stats() const override { return inner->stats(); }
+    Transport::CacheStats cache_stats() const override { return inner->cache_stats(); }
+    unsigned capabilities() const override { return inner->capabilities(); }
+    std::unique_ptr<Transport::StreamState> stream_open() override { return inner->stream_open(); }
+    void feed(Transport::StreamState& s, std::string_view chunk, bool last) override { inner->feed(s, chunk, last); }
+    size_t drain(Transport::StreamState& s, std::span<char> out) override { return inner->drain(s, out); }
+    bool warm() override { return inner->warm(); }
+    TransportError deferred_error() const override { return inner->deferred_error(); }
+};
+
+// Runs the backend factory and stacks the layers opts asks for; null, with
+// error set, when the open fails. The Transport constructor and the lazy
+// layer both go through here.
+IntrusivePtr<Transport::Impl> open_layered(TransportError& error, std::string_view name, const Transport::Options& opts,
+                                           std::pmr::memory_resource* resource);
+
+IntrusivePtr<Transport::Impl> make_queued_impl(IntrusivePtr<Transport::Impl> inner, const Transport::Options& opts);
+IntrusivePtr<Transport::Impl> make_cache_impl(IntrusivePtr<Transport::Impl> inner, size_t capacity);
+IntrusivePtr<Transport::Impl> make_record_impl(IntrusivePtr<Transport::Impl> inner, TransportRecorder& recorder, std::string_view name);
+IntrusivePtr<Transport::Impl> make_metrics_impl(IntrusivePtr<Transport::Impl> inner, std::string_view name);
+// Opens one stack per NUMA node; null, with error set, if any replica fails.
+IntrusivePtr<Transport::Impl> make_replicated_impl(TransportError& error, std::string_view name, const Transport::Options& opts,
+                                                   std::pmr::memory_resource* resource);
+IntrusivePtr<Transport::Impl> make_lazy_impl(std::string_view name, const Transport::Options& opts, std::pmr::memory_resource* resource);
@@ -0,0 +1,111 @@
+#include "ImplLayers.h"
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+// Holds what the constructor was given and opens the real stack of Impls on
+// the first call. After that every call is one acquire load and an indirect
+// call. A failed open is remembered; later calls throw with its error
+// instead of retrying. Counters and stats read as zero until the open, and
+// don't trigger it.
+struct LazyImpl : public Transport::Impl {
+    string name;
+    Transport::Options opts;
+    pmr::memory_resource* resource;
+
+    mutable once_flag once;
+    mutable IntrusivePtr<Transport::Impl> inner;
+    mutable atomic<Transport::Impl*> ready{nullptr};
+    mutable atomic<TransportError> failed{TransportError::none};
+
+    LazyImpl(string_view name, const Transport::Options& opts, pmr::memory_resource* resource)
+        : name(name), opts(opts), resource(resource)
+    {
+        this->opts.lazy = false;
+    }
+
+    // call_once lets a throwing factory be retried by the next caller.
+    bool open() const
+    {
+        if (ready.load(memory_order_acquire))
+            return true;
+        call_once(once, [this] {
+            TransportError error = TransportError::none;
+            auto impl = open_layered(error, name, opts, resource);
+            if (!impl) {
+                failed.store(error != TransportError::none ? error : TransportError::backend_failed, memory_order_release);
+                return;
+            }
+            inner = move(impl);
+            ready.store(inner.get(), memory_order_release);
+        });
+        return ready.load(memory_order_acquire) != nullptr;
+    }
+
+    Transport::Impl& get() const
+    {
+        if (Transport::Impl* impl = ready.load(memory_order_acquire))
+            return *impl;
+        if (!open())
+            throw_transport_closed(failed.load(memory_order_acquire));
+        return *ready.load(memory_order_acquire);
+    }
+
+    // Null before the open; for calls that report instead of doing work.
+    Transport::Impl* opened() const { return ready.load(memory_order_acquire); }
+
+    bool warm() override { return open(); }
+    TransportError deferred_error() const override { return failed.load(memory_order_acquire); }
+
+    string process(string_view arg) override { return get().process(arg); }
+    string process_owned(string&& arg) override { return get().process_owned(move(arg)); }
+    void process_into(string_view arg, string& out) override { get().process_into(arg, out); }
+    void process_into(string_view arg, pmr::string& out) override { get().process_into(arg, out); }
+    void process_batch(span<const string_view> args, vector<string>& out) override { get().process_batch(args, out); }
+    void process_fragments(span<const string_view> in, TransportFragments& out) override { get().process_fragments(in, out); }
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override { get().process_with_callable(func); }
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Transport::Uuid>)> fill) override
+    {
+        get().process_with_callable_range(first, count, fill);
+    }
+    unique_ptr<Transport::StreamState> stream_open() override { return get().stream_open(); }
+    void feed(Transport::StreamState& s, string_view chunk, bool last) override { get().feed(s, chunk, last); }
+    size_t drain(Transport::StreamState& s, span<char> out) override { return get().drain(s, out); }
+
+    // What the handle can do depends on the backend, so this one opens it.
+    unsigned capabilities() const override { return get().capabilities(); }
+
+    size_t total_processed() const override
+    {
+        auto* impl = opened();
+        return impl ? impl->total_processed() : 0;
+    }
+
+    Transport::QueueStats queue_stats() const override
+    {
+        auto* impl = opened();
+        return impl ? impl->queue_stats() : Transport::QueueStats();
+    }
+
+    Transport::Stats stats() const override
+    {
+        auto* impl = opened();
+        return impl ? impl->stats() : Transport::Stats();
+    }
+
+    Transport::CacheStats cache_stats() const override
+    {
+        auto* impl = opened();
+        return impl ? impl->cache_stats() : Transport::CacheStats();
+    }
+};
+
+}
+
+IntrusivePtr<Transport::Impl> make_lazy_impl(string_view name, const Transport::Options& opts, pmr::memory_resource* resource)
+{
+    return make_intrusive<LazyImpl>(name, opts, resource);
+}
@@ -0,0 +1,204 @@
+#include "ImplLayers.h"
+#include "ThreadShard.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct MetricsImpl;
+
+// Live instrumented Impls, for export_stats(). Never destroyed, like the
+// other process-wide tables.
+struct MetricsRegistry {
+    mutex lock;
+    vector<MetricsImpl*> live;
+    atomic<Transport::StatsExporter*> exporter{nullptr};
+};
+
+MetricsRegistry& registry()
+{
+    static MetricsRegistry* reg = new MetricsRegistry;
+    return *reg;
+}
+
+// Wraps an Impl and counts every call into per-thread shards; stats() sums
+// the shards. Each thread writes its own cache lines, so recording is a
+// clock read and a few uncontended relaxed increments.
+struct MetricsImpl : public ForwardingImpl {
+    static constexpr size_t shard_count = 16;
+
+    struct Calls {
+        atomic<uint64_t> calls{0};
+        atomic<uint64_t> bytes_in{0};
+        atomic<uint64_t> bytes_out{0};
+        atomic<uint64_t> total_ns{0};
+        atomic<uint64_t> buckets[LatencyHistogram::bucket_count] = {};
+    };
+
+    struct alignas(64) Shard {
+        Calls process;
+        Calls batch;
+        Calls callable;
+    };
+
+    // Stamps the start and records the call on scope exit, so calls that
+    // throw are counted too.
+    struct Timed {
+        Calls& into;
+        uint64_t bytes_in;
+        uint64_t bytes_out = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        ~Timed()
+        {
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            into.calls.fetch_add(1, memory_order_relaxed);
+            into.bytes_in.fetch_add(bytes_in, memory_order_relaxed);
+            into.bytes_out.fetch_add(bytes_out, memory_order_relaxed);
+            into.total_ns.fetch_add(uint64_t(ns), memory_order_relaxed);
+            into.buckets[LatencyHistogram::bucket_of(uint64_t(ns))].fetch_add(1, memory_order_relaxed);
+        }
+    };
+
+    string name;
+    unique_ptr<Shard[]> shards;
+
+    MetricsImpl(IntrusivePtr<Transport::Impl> inner, string_view name)
+        : ForwardingImpl(move(inner)), name(name), shards(make_unique<Shard[]>(shard_count))
+    {
+        auto& reg = registry();
+        lock_guard<mutex> guard(reg.lock);
+        reg.live.push_back(this);
+    }
+
+    ~MetricsImpl()
+    {
+        auto& reg = registry();
+        {
+            lock_guard<mutex> guard(reg.lock);
+            reg.live.erase(find(reg.live.begin(), reg.live.end(), this));
+        }
+        if (auto* exporter = reg.exporter.load(memory_order_acquire))
+            exporter->export_stats(name, stats());
+    }
+
+    Shard& shard() { return shards[thread_shard_index() % shard_count]; }
+
+    string process(string_view arg) override
+    {
+        Timed t{ shard().process, arg.size() };
+        string out = inner->process(arg);
+        t.bytes_out = out.size();
+        return out;
+    }
+
+    string process_owned(string&& arg) override
+    {
+        Timed t{ shard().process, arg.size() };
+        string out = inner->process_owned(move(arg));
+        t.bytes_out = out.size();
+        return out;
+    }
+
+    void process_into(string_view arg, string& out) override
+    {
+        Timed t{ shard().process, arg.size() };
+        inner->process_into(arg, out);
+        t.bytes_out = out.size();
+    }
+
+    void process_into(string_view arg, pmr::string& out) override
+    {
+        Timed t{ shard().process, arg.size() };
+        inner->process_into(arg, out);
+        t.bytes_out = out.size();
+    }
+
+    // Counted with process: it is one call, just with a split argument.
+    void process_fragments(span<const string_view> in, TransportFragments& out) override
+    {
+        uint64_t bytes = 0;
+        for (string_view part : in)
+            bytes += part.size();
+        Timed t{ shard().process, bytes };
+        inner->process_fragments(in, out);
+        t.bytes_out = out.size();
+    }
+
+    void process_batch(span<const string_view> args, vector<string>& out) override
+    {
+        uint64_t in = 0;
+        for (string_view arg : args)
+            in += arg.size();
+        Timed t{ shard().batch, in };
+        inner->process_batch(args, out);
+        for (const string& s : out)
+            t.bytes_out += s.size();
+    }
+
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override
+    {
+        Timed t{ shard().callable, 0 };
+        inner->process_with_callable(func);
+    }
+
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Transport::Uuid>)> fill) override
+    {
+        Timed t{ shard().callable, 0 };
+        inner->process_with_callable_range(first, count, fill);
+    }
+
+    static void merge(Transport::CallStats& into, const Calls& from)
+    {
+        into.calls += from.calls.load(memory_order_relaxed);
+        into.bytes_in += from.bytes_in.load(memory_order_relaxed);
+        into.bytes_out += from.bytes_out.load(memory_order_relaxed);
+        into.total_ns += from.total_ns.load(memory_order_relaxed);
+        for (size_t i = 0; i < LatencyHistogram::bucket_count; i++)
+            into.latency.counts[i] += from.buckets[i].load(memory_order_relaxed);
+    }
+
+    // Not a consistent cut: calls finishing during the merge may be counted
+    // in one field and not yet in another.
+    Transport::Stats stats() const override
+    {
+        Transport::Stats stats;
+        stats.instrumented = true;
+        for (size_t i = 0; i < shard_count; i++) {
+            merge(stats.process, shards[i].process);
+            merge(stats.batch, shards[i].batch);
+            merge(stats.callable, shards[i].callable);
+        }
+        return stats;
+    }
+};
+
+}
+
+IntrusivePtr<Transport::Impl> make_metrics_impl(IntrusivePtr<Transport::Impl> inner, string_view name)
+{
+    return make_intrusive<MetricsImpl>(move(inner), name);
+}
+
+void Transport::set_stats_exporter(StatsExporter* exporter)
+{
+    registry().exporter.store(exporter, memory_order_release);
+}
+
+// Holds the registry lock while exporting, so no Impl can finish destroying
+// itself in the middle; an exporter must not open or drop handles.
+void Transport::export_stats()
+{
+    auto& reg = registry();
+    auto* exporter = reg.exporter.load(memory_order_acquire);
+    if (!exporter)
+        return;
+    lock_guard<mutex> guard(reg.lock);
+    for (MetricsImpl* impl : reg.live)
+        exporter->export_stats(impl->name, impl->stats());
+}
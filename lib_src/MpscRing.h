@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free ring for many producers and a single consumer. Each cell
+// carries a sequence number telling producers and the consumer whose turn it
+// is, so no side ever waits on a lock. Capacity is rounded up to a power of two.
+template<class T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity)
+            n *= 2;
+        mask = n - 1;
+        cells = std::make_unique<Cell[]>(n);
+        for (size_t i = 0; i < n; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Returns false without blocking when the ring is full.
+    template<class U>
+    bool try_push(U&& value)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            std::intptr_t diff = std::intptr_t(seq) - std::intptr_t(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::forward<U>(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only.
+    bool try_pop(T& out)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos & mask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1)
+            return false;
+
+        out = std::move(cell.value);
+        cell.seq.store(pos + mask + 1, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Claimed slots not yet consumed; exact only when no push is in flight.
+    size_t size() const
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+
+    // Total slots ever claimed by producers.
+    size_t pushed() const { return head.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
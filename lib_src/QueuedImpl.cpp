@@ -0,0 +1,290 @@
+#include "ImplLayers.h"
+#include "CpuTopology.h"
+#include "MpscRing.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+// Calls always block until drained, so a request only points at the
+// caller's arguments and result storage. The drain thread sets ready last,
+// once it is done with the request; the caller may then return at once.
+struct Completion {
+    atomic<uint32_t> ready{0};
+    exception_ptr error;
+};
+
+struct Request {
+    span<const string_view> args;
+    string* out = nullptr;
+    vector<string>* outs = nullptr;
+    Completion* done = nullptr;
+};
+
+// Callers on any thread push into a bounded MPSC ring; one drain thread
+// collects whatever is queued and hands it to the inner Impl as a single
+// process_batch. The callable calls and the counter and stats reads take
+// inner_lock, which the drain thread holds around each batch, so the inner
+// Impl only ever sees one thread at a time. capabilities, warm and
+// deferred_error touch no per-call state and go straight through.
+struct QueuedImpl : public ForwardingImpl {
+    static constexpr size_t max_drain = 64;
+
+    MpscRing<Request> ring;
+    mutable mutex inner_lock;
+    Transport::Backpressure policy;
+    atomic<unsigned> wake{0};
+    atomic<bool> sleeping{false};
+    atomic<bool> stopping{false};
+    // Bumped after each drained batch; producers blocked on a full ring wait on it.
+    atomic<unsigned> popped{0};
+    atomic<size_t> blocked{0};
+    atomic<size_t> high_water{0};
+    atomic<size_t> dropped{0};
+    atomic<size_t> rejected{0};
+    thread drainer;
+
+    QueuedImpl(IntrusivePtr<Transport::Impl> inner, const Transport::Options& opts)
+        : ForwardingImpl(move(inner)), ring(opts.queue_capacity), policy(opts.backpressure),
+          drainer([this, cpu = opts.drain_cpu] {
+              if (cpu >= 0)
+                  pin_current_thread({ cpu });
+              drain();
+          })
+    {
+    }
+
+    ~QueuedImpl()
+    {
+        stopping.store(true, memory_order_seq_cst);
+        wake.fetch_add(1, memory_order_seq_cst);
+        wake.notify_one();
+        drainer.join();
+    }
+
+    string process(string_view arg) override
+    {
+        string out;
+        process_into(arg, out);
+        return out;
+    }
+
+    // Requests point at the caller's argument, so there is nothing to steal.
+    string process_owned(string&& arg) override { return process(string_view(arg)); }
+
+    void process_into(string_view arg, string& out) override
+    {
+        Request req;
+        req.args = span<const string_view>(&arg, 1);
+        req.out = &out;
+        submit(req);
+    }
+
+    // The drain thread only fills std::strings, so this still queues.
+    void process_into(string_view arg, pmr::string& out) override
+    {
+        string tmp;
+        process_into(arg, tmp);
+        out.assign(tmp);
+    }
+
+    void process_batch(span<const string_view> args, vector<string>& out) override
+    {
+        Request req;
+        req.args = args;
+        req.outs = &out;
+        submit(req);
+    }
+
+    // Fragments and streams go through the joining defaults, so the inner
+    // Impl still only sees the drain thread, via process().
+    void process_fragments(span<const string_view> in, TransportFragments& out) override { Transport::Impl::process_fragments(in, out); }
+    unique_ptr<Transport::StreamState> stream_open() override { return Transport::Impl::stream_open(); }
+    void feed(Transport::StreamState& s, string_view chunk, bool last) override { Transport::Impl::feed(s, chunk, last); }
+    size_t drain(Transport::StreamState& s, span<char> out) override { return Transport::Impl::drain(s, out); }
+
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override
+    {
+        lock_guard<mutex> guard(inner_lock);
+        inner->process_with_callable(func);
+    }
+
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Transport::Uuid>)> fill) override
+    {
+        lock_guard<mutex> guard(inner_lock);
+        inner->process_with_callable_range(first, count, fill);
+    }
+
+    size_t total_processed() const override
+    {
+        lock_guard<mutex> guard(inner_lock);
+        return inner->total_processed();
+    }
+
+    Transport::Stats stats() const override
+    {
+        lock_guard<mutex> guard(inner_lock);
+        return inner->stats();
+    }
+
+    Transport::CacheStats cache_stats() const override
+    {
+        lock_guard<mutex> guard(inner_lock);
+        return inner->cache_stats();
+    }
+
+    Transport::QueueStats queue_stats() const override
+    {
+        Transport::QueueStats stats;
+        stats.depth = ring.size();
+        stats.capacity = ring.capacity();
+        stats.high_water = high_water.load(memory_order_relaxed);
+        stats.enqueued = ring.pushed();
+        stats.dropped = dropped.load(memory_order_relaxed);
+        stats.rejected = rejected.load(memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    void submit(Request& req)
+    {
+        Completion done;
+        req.done = &done;
+
+        while (!ring.try_push(req)) {
+            if (policy == Transport::Backpressure::drop) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                clear_outputs(req);
+                return;
+            }
+            if (policy == Transport::Backpressure::fail_fast) {
+                rejected.fetch_add(1, memory_order_relaxed);
+                throw runtime_error("transport queue full");
+            }
+            // Announce the wait before the last try, so a drain that frees
+            // a slot either lets this push through or sees us blocked.
+            unsigned seen = popped.load(memory_order_seq_cst);
+            blocked.fetch_add(1, memory_order_seq_cst);
+            bool pushed = ring.try_push(req);
+            if (!pushed)
+                popped.wait(seen, memory_order_seq_cst);
+            blocked.fetch_sub(1, memory_order_seq_cst);
+            if (pushed)
+                break;
+        }
+
+        wake.fetch_add(1, memory_order_seq_cst);
+        if (sleeping.load(memory_order_seq_cst))
+            wake.notify_one();
+
+        done.ready.wait(0, memory_order_acquire);
+        if (done.error)
+            rethrow_exception(done.error);
+    }
+
+    static void clear_outputs(Request& req)
+    {
+        if (req.out)
+            req.out->clear();
+        if (req.outs)
+            req.outs->clear();
+    }
+
+    void drain()
+    {
+        vector<Request> reqs;
+        vector<string_view> args;
+        vector<string> outs;
+        Request req;
+
+        for (;;) {
+            unsigned seen = wake.load(memory_order_seq_cst);
+            size_t depth = ring.size();
+            if (depth > high_water.load(memory_order_relaxed))
+                high_water.store(depth, memory_order_relaxed);
+
+            reqs.clear();
+            args.clear();
+            while (reqs.size() < max_drain && ring.try_pop(req)) {
+                reqs.push_back(req);
+                args.insert(args.end(), req.args.begin(), req.args.end());
+            }
+
+            if (reqs.empty()) {
+                if (stopping.load(memory_order_seq_cst))
+                    return;
+                sleeping.store(true, memory_order_seq_cst);
+                if (ring.size() == 0)
+                    wake.wait(seen, memory_order_seq_cst);
+                sleeping.store(false, memory_order_seq_cst);
+                continue;
+            }
+
+            popped.fetch_add(1, memory_order_seq_cst);
+            if (blocked.load(memory_order_seq_cst))
+                popped.notify_all();
+
+            exception_ptr error = run_batch(args, outs);
+            if (error && reqs.size() > 1) {
+                // One failing argument fails the whole batch, so run each
+                // request again on its own and give every caller its own
+                // result or error. Counter values the failed batch claimed
+                // are skipped.
+                for (Request& r : reqs)
+                    complete(r, outs, 0, run_batch(r.args, outs));
+                continue;
+            }
+
+            size_t at = 0;
+            for (Request& r : reqs) {
+                complete(r, outs, at, error);
+                at += r.args.size();
+            }
+        }
+    }
+
+    exception_ptr run_batch(span<const string_view> args, vector<string>& outs)
+    {
+        lock_guard<mutex> guard(inner_lock);
+        try {
+            inner->process_batch(args, outs);
+        } catch (...) {
+            return current_exception();
+        }
+        return nullptr;
+    }
+
+    // Hands r its results, outs[at] on, or error, and releases its caller.
+    static void complete(Request& r, vector<string>& outs, size_t at, exception_ptr error)
+    {
+        if (!error) {
+            if (r.out) {
+                swap(*r.out, outs[at]);
+            } else {
+                r.outs->resize(r.args.size());
+                for (size_t i = 0; i < r.args.size(); i++)
+                    swap((*r.outs)[i], outs[at + i]);
+            }
+        }
+
+        Completion* done = r.done;
+        done->error = move(error);
+        // The caller can return as soon as the store lands. notify_one only
+        // uses the address (a futex wake and libstdc++'s waiter table), not
+        // the Completion's memory, so it is safe after that.
+        done->ready.store(1, memory_order_release);
+        done->ready.notify_one();
+    }
+};
+
+}
+
+IntrusivePtr<Transport::Impl> make_queued_impl(IntrusivePtr<Transport::Impl> inner, const Transport::Options& opts)
+{
+    return make_intrusive<QueuedImpl>(move(inner), opts);
+}
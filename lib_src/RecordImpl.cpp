@@ -0,0 +1,138 @@
+#include "ImplLayers.h"
+#include "TransportRecord.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+using namespace std;
+
+struct TransportRecorder::State {
+    FILE* file = nullptr;
+    mutex lock;
+    uint64_t next_seq = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+};
+
+TransportRecorder::TransportRecorder(const string& path) : state(new State)
+{
+    state->file = fopen(path.c_str(), "wb");
+    if (state->file)
+        fwrite(transport_record_magic, 1, sizeof(transport_record_magic), state->file);
+}
+
+TransportRecorder::~TransportRecorder()
+{
+    if (state->file)
+        fclose(state->file);
+}
+
+bool TransportRecorder::is_open() const
+{
+    return state->file != nullptr;
+}
+
+uint64_t TransportRecorder::now_ns() const
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - state->start).count();
+}
+
+void TransportRecorder::append(string_view name, string_view arg, string_view result, uint64_t start_ns, uint64_t duration_ns,
+                               uint64_t processed)
+{
+    if (!state->file)
+        return;
+
+    TransportRecordHeader h{};
+    h.name_len = uint32_t(name.size());
+    h.arg_len = uint32_t(arg.size());
+    h.result_len = uint32_t(result.size());
+    h.start_ns = start_ns;
+    h.duration_ns = duration_ns;
+    h.processed = processed;
+    static const char zeros[8] = {};
+    size_t pad = h.payload_size() - (name.size() + arg.size() + result.size());
+
+    lock_guard<mutex> guard(state->lock);
+    h.seq = state->next_seq++;
+    fwrite(&h, sizeof(h), 1, state->file);
+    fwrite(name.data(), 1, name.size(), state->file);
+    fwrite(arg.data(), 1, arg.size(), state->file);
+    fwrite(result.data(), 1, result.size(), state->file);
+    fwrite(zeros, 1, pad, state->file);
+}
+
+void TransportRecorder::flush()
+{
+    lock_guard<mutex> guard(state->lock);
+    if (state->file)
+        fflush(state->file);
+}
+
+uint64_t TransportRecorder::records() const
+{
+    lock_guard<mutex> guard(state->lock);
+    return state->next_seq;
+}
+
+namespace {
+
+// Appends a record for every process-style call after it returns. Batches
+// are logged one record per element, all with the batch's timing; the
+// callable, fragment and stream calls pass through unrecorded.
+struct RecordImpl : public ForwardingImpl {
+    TransportRecorder& recorder;
+    string name;
+
+    RecordImpl(IntrusivePtr<Transport::Impl> inner, TransportRecorder& recorder, string_view name)
+        : ForwardingImpl(move(inner)), recorder(recorder), name(name)
+    {
+    }
+
+    string process(string_view arg) override
+    {
+        uint64_t start = recorder.now_ns();
+        string out = inner->process(arg);
+        recorder.append(name, arg, out, start, recorder.now_ns() - start, inner->total_processed());
+        return out;
+    }
+
+    // The argument has to survive the call to be logged.
+    string process_owned(string&& arg) override { return process(string_view(arg)); }
+
+    void process_into(string_view arg, string& out) override
+    {
+        uint64_t start = recorder.now_ns();
+        inner->process_into(arg, out);
+        recorder.append(name, arg, out, start, recorder.now_ns() - start, inner->total_processed());
+    }
+
+    void process_into(string_view arg, pmr::string& out) override
+    {
+        uint64_t start = recorder.now_ns();
+        inner->process_into(arg, out);
+        recorder.append(name, arg, out, start, recorder.now_ns() - start, inner->total_processed());
+    }
+
+    void process_batch(span<const string_view> args, vector<string>& out) override
+    {
+        uint64_t before = inner->total_processed();
+        uint64_t start = recorder.now_ns();
+        inner->process_batch(args, out);
+        uint64_t duration = recorder.now_ns() - start;
+        uint64_t after = inner->total_processed();
+        // Only when the counter moved once per element does each element
+        // have a value of its own; cache hits, or a retried queued batch,
+        // break that, and every element then gets the total.
+        bool per_element = after - before == out.size();
+        // A dropped queued batch comes back empty.
+        for (size_t i = 0; i < args.size() && i < out.size(); i++)
+            recorder.append(name, args[i], out[i], start, duration, per_element ? before + i + 1 : after);
+    }
+};
+
+}
+
+IntrusivePtr<Transport::Impl> make_record_impl(IntrusivePtr<Transport::Impl> inner, TransportRecorder& recorder, string_view name)
+{
+    return make_intrusive<RecordImpl>(move(inner), recorder, name);
+}
@@ -0,0 +1,132 @@
+#include "ImplLayers.h"
+#include "CpuTopology.h"
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+// One full stack per NUMA node. Each call goes to the replica of the node
+// the caller is running on, so the Impl's counters and buffers stay in
+// that node's memory and caches; the reporting calls sum every replica.
+struct ReplicatedImpl : public Transport::Impl {
+    vector<IntrusivePtr<Transport::Impl>> replicas;
+
+    explicit ReplicatedImpl(vector<IntrusivePtr<Transport::Impl>> replicas) : replicas(move(replicas)) {}
+
+    Transport::Impl& local() const { return *replicas[cpu_topology().current_node() % replicas.size()]; }
+
+    string process(string_view arg) override { return local().process(arg); }
+    string process_owned(string&& arg) override { return local().process_owned(move(arg)); }
+    void process_into(string_view arg, string& out) override { local().process_into(arg, out); }
+    void process_into(string_view arg, pmr::string& out) override { local().process_into(arg, out); }
+    void process_batch(span<const string_view> args, vector<string>& out) override { local().process_batch(args, out); }
+    void process_fragments(span<const string_view> in, TransportFragments& out) override { local().process_fragments(in, out); }
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func) override { local().process_with_callable(func); }
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Transport::Uuid>)> fill) override
+    {
+        local().process_with_callable_range(first, count, fill);
+    }
+
+    // Every replica is built from the same options, so they agree.
+    unsigned capabilities() const override { return replicas.front()->capabilities(); }
+
+    // Streams keep the base defaults: the thread can change nodes between
+    // chunks, and the joined argument goes to whichever replica is local.
+
+    size_t total_processed() const override
+    {
+        size_t total = 0;
+        for (auto& r : replicas)
+            total += r->total_processed();
+        return total;
+    }
+
+    Transport::QueueStats queue_stats() const override
+    {
+        Transport::QueueStats total;
+        for (auto& r : replicas) {
+            Transport::QueueStats s = r->queue_stats();
+            total.depth += s.depth;
+            total.capacity += s.capacity;
+            total.high_water = max(total.high_water, s.high_water);
+            total.enqueued += s.enqueued;
+            total.dropped += s.dropped;
+            total.rejected += s.rejected;
+        }
+        return total;
+    }
+
+    static void merge(Transport::CallStats& into, const Transport::CallStats& from)
+    {
+        into.calls += from.calls;
+        into.bytes_in += from.bytes_in;
+        into.bytes_out += from.bytes_out;
+        into.total_ns += from.total_ns;
+        into.latency.merge(from.latency);
+    }
+
+    Transport::Stats stats() const override
+    {
+        Transport::Stats total;
+        for (auto& r : replicas) {
+            Transport::Stats s = r->stats();
+            total.instrumented |= s.instrumented;
+            merge(total.process, s.process);
+            merge(total.batch, s.batch);
+            merge(total.callable, s.callable);
+        }
+        return total;
+    }
+
+    Transport::CacheStats cache_stats() const override
+    {
+        Transport::CacheStats total;
+        for (auto& r : replicas) {
+            Transport::CacheStats s = r->cache_stats();
+            total.hits += s.hits;
+            total.misses += s.misses;
+            total.evictions += s.evictions;
+            total.size += s.size;
+            total.capacity += s.capacity;
+        }
+        return total;
+    }
+};
+
+}
+
+// The kernel places pages on the node of the thread that first touches
+// them, and a thread inherits its creator's CPU mask, so building each
+// stack from a thread pinned to the node keeps its memory, and any drain
+// thread it starts, on that node. The caller's resource would hand every
+// node memory from the same arena, so replicas use the default heap.
+IntrusivePtr<Transport::Impl> make_replicated_impl(TransportError& error, string_view name, const Transport::Options& opts,
+                                                   pmr::memory_resource*)
+{
+    const CpuTopology& topo = cpu_topology();
+    Transport::Options replica_opts = opts;
+    replica_opts.numa_replicas = false;
+    replica_opts.drain_cpu = -1;
+
+    vector<IntrusivePtr<Transport::Impl>> replicas(topo.nodes());
+    for (size_t node = 0; node < topo.nodes(); node++) {
+        exception_ptr failure;
+        thread opener([&] {
+            try {
+                pin_current_thread(topo.node_cpus[node]);
+                replicas[node] = open_layered(error, name, replica_opts, nullptr);
+            } catch (...) {
+                failure = current_exception();
+            }
+        });
+        opener.join();
+        if (failure)
+            rethrow_exception(failure);
+        if (!replicas[node])
+            return nullptr;
+    }
+    return make_intrusive<ReplicatedImpl>(move(replicas));
+}
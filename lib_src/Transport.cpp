@@ -1,6 +1,19 @@
 #include "Transport.h"
+#include "CpuTopology.h"
+#include "ImplLayers.h"
+#include "ThreadShard.h"
+#include "TransportBackend.h"
+#include "TransportTrace.h"
+#include "WorkPool.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 
 using namespace std;
 
@@ -46,18 +59,419 @@ using namespace std;
 //     }
 // };
 
-std::shared_ptr<Transport::Impl> TransportImpl_factory(string& fail_desc, const string& name);
+// Dispatches to the backend registered for name's scheme.
+static IntrusivePtr<Transport::Impl> open_impl(TransportError& error, string_view name, const Transport::Options& opts,
+                                               pmr::memory_resource* resource = nullptr)
+{
+    string_view rest;
+    TransportFactory factory = TransportBackends::find(name, rest);
+    if (!factory) {
+        error = TransportError::no_backend;
+        return nullptr;
+    }
+    auto impl = factory(error, rest, opts, resource);
+    if (error != TransportError::none)
+        return nullptr;
+    if (!impl)
+        error = TransportError::backend_failed;
+    return impl;
+}
+
+Transport::Transport(string_view name) : Transport(name, Options())
+{
+}
+
+Transport::Transport(string_view name, const Options& opts) : Transport(name, opts, nullptr)
+{
+}
+
+IntrusivePtr<Transport::Impl> open_layered(TransportError& error, string_view name, const Transport::Options& opts, pmr::memory_resource* resource)
+{
+    if (opts.numa_replicas && cpu_topology().nodes() > 1)
+        return make_replicated_impl(error, name, opts, resource);
+
+    auto impl = open_impl(error, name, opts, resource);
+    if (!impl)
+        return impl;
+    if (opts.queue_capacity)
+        impl = make_queued_impl(move(impl), opts);
+    // Above the queue, so a hit never waits in it.
+    if (opts.cache_capacity && (impl->capabilities() & Transport::idempotent))
+        impl = make_cache_impl(move(impl), opts.cache_capacity);
+    if (opts.recorder)
+        impl = make_record_impl(move(impl), *opts.recorder, name);
+    if (opts.metrics)
+        impl = make_metrics_impl(move(impl), name);
+    return impl;
+}
+
+Transport::Transport(string_view name, const Options& opts, pmr::memory_resource* resource)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::open", nullptr, name.size());
+    // Queued calls run on the drain thread, which confinement rules out.
+    if (opts.thread_confined && opts.queue_capacity) {
+        open_err = TransportError::bad_options;
+        return;
+    }
+    if (opts.lazy)
+        pImpl = make_lazy_impl(name, opts, resource);
+    else
+        pImpl = open_layered(open_err, name, opts, resource);
+    if (pImpl && opts.thread_confined)
+        pImpl->confine_to_thread();
+    // The span starts before there is an Impl; this ties the open to it.
+    TRANSPORT_TRACE_INSTANT("Transport::opened", pImpl.get(), name.size());
+}
+
+optional<Transport> Transport::try_open(string_view name, TransportError& error)
+{
+    return try_open(name, Options(), error);
+}
+
+optional<Transport> Transport::try_open(string_view name, const Options& opts, TransportError& error)
+{
+    Transport handle(name, opts);
+    error = handle.open_err;
+    if (!handle.is_open())
+        return nullopt;
+    return handle;
+}
+
+void throw_transport_closed(TransportError error)
+{
+    if (error == TransportError::none)
+        throw runtime_error("transport not open");
+    throw runtime_error(string("transport not open: ") + transport_error_message(error));
+}
+
+namespace {
+
+struct InternEntry;
+
+// Interned Impls are wrapped so that losing the last handle evicts the entry.
+// The wrapper's memory is owned by its InternEntry instead, and is only freed
+// once no table snapshot that a lookup could be reading still lists it.
+struct InternedImpl : public ForwardingImpl {
+    InternEntry* entry = nullptr;
+
+    using ForwardingImpl::ForwardingImpl;
+    void destroy() noexcept override;
+};
+
+struct InternEntry {
+    string name;
+    InternedImpl* impl;
+
+    ~InternEntry() { delete impl; }
+};
 
-Transport::Transport(const string& name) : pImpl(TransportImpl_factory(open_fail_desc, name))
+// Interned Impls by name. Lookups read an immutable snapshot through a raw
+// atomic pointer; they take no lock and share no reference count, and only
+// bump their own shard's reader count for the current epoch parity. Opens
+// and evictions copy the table under write_lock, publish the copy and
+// retire the old one, which is freed two epoch flips later: a flip needs
+// every reader of the parity it moves to to have left, so after two, no
+// reader that could have loaded the old table remains.
+struct InternTable {
+    typedef map<string, shared_ptr<InternEntry>, less<>> Map;
+
+    static constexpr size_t reader_shards = 64;
+
+    // One line per shard, so readers on different threads don't share one.
+    struct alignas(64) Readers {
+        atomic<size_t> active[2] = {};
+    };
+
+    struct RetiredMap {
+        uint64_t epoch;
+        unique_ptr<const Map> map;
+    };
+
+    mutex write_lock;
+    atomic<const Map*> snapshot{new Map()};
+    atomic<uint64_t> epoch{0};
+    unique_ptr<Readers[]> readers{make_unique<Readers[]>(reader_shards)};
+    // Tables no longer published, oldest first, with the epoch they left at.
+    vector<RetiredMap> retired_maps;
+    // Entries replaced while their Impl was on its way out. Each one's
+    // destroy() is still to reach evict(), which must find it alive.
+    vector<shared_ptr<InternEntry>> retired;
+
+    // Whatever table the load returns stays alive until the reader count is
+    // dropped, and try_retain refuses a wrapper whose last handle is gone.
+    IntrusivePtr<Transport::Impl> find(string_view name) const
+    {
+        Readers& r = readers[thread_shard_index() % reader_shards];
+        size_t parity = epoch.load(memory_order_seq_cst) & 1;
+        r.active[parity].fetch_add(1, memory_order_seq_cst);
+
+        IntrusivePtr<Transport::Impl> found;
+        const Map* snap = snapshot.load(memory_order_seq_cst);
+        auto it = snap->find(name);
+        if (it != snap->end() && it->second->impl->try_retain())
+            found = IntrusivePtr<Transport::Impl>::adopt(it->second->impl);
+
+        r.active[parity].fetch_sub(1, memory_order_release);
+        return found;
+    }
+
+    // Takes the lock only when the fast path missed; also replaces an entry
+    // whose Impl is on its way out.
+    IntrusivePtr<Transport::Impl> open(string_view name, TransportError& error)
+    {
+        vector<RetiredMap> freed;
+        lock_guard<mutex> guard(write_lock);
+        if (auto found = find(name))
+            return found;
+
+        auto impl = open_impl(error, name, Transport::Options());
+        if (!impl)
+            return nullptr;
+
+        auto entry = make_shared<InternEntry>();
+        entry->name = name;
+        entry->impl = new InternedImpl(move(impl));
+        entry->impl->entry = entry.get();
+        IntrusivePtr<Transport::Impl> result(entry->impl);
+
+        auto next = make_unique<Map>(*snapshot.load(memory_order_relaxed));
+        auto& slot = (*next)[string(name)];
+        if (slot)
+            retired.push_back(move(slot));
+        slot = move(entry);
+        publish(move(next), freed);
+        return result;
+    }
+
+    // entry is alive until here: it is either listed in the snapshot or
+    // retired. The last reference may be the one dropped here, freeing entry
+    // and the wrapper that called us, so nothing touches either afterwards;
+    // doomed and freed are released only after the lock.
+    void evict(InternEntry* entry)
+    {
+        vector<RetiredMap> freed;
+        shared_ptr<InternEntry> doomed;
+        lock_guard<mutex> guard(write_lock);
+
+        // A newer Impl already replaced this entry.
+        auto r = find_if(retired.begin(), retired.end(), [entry](auto& e) { return e.get() == entry; });
+        if (r != retired.end()) {
+            doomed = move(*r);
+            retired.erase(r);
+            return;
+        }
+
+        const Map* snap = snapshot.load(memory_order_relaxed);
+        auto it = snap->find(entry->name);
+        if (it == snap->end() || it->second.get() != entry)
+            return;
+
+        auto next = make_unique<Map>(*snap);
+        next->erase(entry->name);
+        publish(move(next), freed);
+    }
+
+private:
+    // Under write_lock. Moves the tables no reader can still hold to freed.
+    void publish(unique_ptr<const Map> next, vector<RetiredMap>& freed)
+    {
+        const Map* old = snapshot.exchange(next.release(), memory_order_seq_cst);
+        retired_maps.push_back({ epoch.load(memory_order_relaxed), unique_ptr<const Map>(old) });
+
+        for (int flips = 0; flips < 2; flips++) {
+            uint64_t e = epoch.load(memory_order_relaxed);
+            if (!drained((e + 1) & 1))
+                break;
+            epoch.store(e + 1, memory_order_seq_cst);
+        }
+
+        uint64_t now = epoch.load(memory_order_relaxed);
+        auto live = find_if(retired_maps.begin(), retired_maps.end(), [now](auto& m) { return m.epoch + 2 > now; });
+        move(retired_maps.begin(), live, back_inserter(freed));
+        retired_maps.erase(retired_maps.begin(), live);
+    }
+
+    bool drained(size_t parity) const
+    {
+        for (size_t i = 0; i < reader_shards; i++)
+            if (readers[i].active[parity].load(memory_order_seq_cst))
+                return false;
+        return true;
+    }
+};
+
+// Never destroyed: interned handles may still be released during exit.
+InternTable& intern_table()
 {
+    static InternTable* table = new InternTable;
+    return *table;
 }
 
-string Transport::process(const string& arg)
+void InternedImpl::destroy() noexcept
 {
-    return pImpl->process(arg);
+    intern_table().evict(entry);
+}
+
+}
+
+Transport Transport::open_shared(string_view name)
+{
+    auto& table = intern_table();
+    if (auto impl = table.find(name))
+        return Transport(TransportError::none, move(impl));
+
+    TransportError error = TransportError::none;
+    auto impl = table.open(name, error);
+    return Transport(error, move(impl));
+}
+
+string Transport::process(string_view arg)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process", pImpl.get(), arg.size());
+    return checked_impl().process(arg);
+}
+
+string Transport::process(string&& arg)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process", pImpl.get(), arg.size());
+    return checked_impl().process_owned(move(arg));
+}
+
+void Transport::process_into(string_view arg, string& out)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_into", pImpl.get(), arg.size());
+    checked_impl().process_into(arg, out);
+}
+
+void Transport::process_into(string_view arg, pmr::string& out)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_into", pImpl.get(), arg.size());
+    checked_impl().process_into(arg, out);
+}
+
+void Transport::process_batch(span<const string_view> args, vector<string>& out)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_batch", pImpl.get(), args.size());
+    checked_impl().process_batch(args, out);
+}
+
+void Transport::process_fragments(span<const string_view> in, TransportFragments& out)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_fragments", pImpl.get(), in.size());
+    checked_impl().process_fragments(in, out);
+}
+
+TransportStream Transport::open_stream()
+{
+    TRANSPORT_TRACE_SCOPE("Transport::open_stream", pImpl.get(), 0);
+    Impl& impl = checked_impl();
+    return TransportStream(pImpl, impl.stream_open());
+}
+
+void TransportStream::check_writable() const
+{
+    if (state->input_done)
+        throw logic_error("stream already finished");
+}
+
+namespace {
+
+// Future state, handle, argument and pool node in one allocation (the
+// argument adds one past the short-string size). The node holds a reference
+// to itself while queued, dropped when it runs.
+struct AsyncProcess : FutureState<string>, WorkPool::Task {
+    Transport handle;
+    string arg;
+    shared_ptr<AsyncProcess> self;
+
+    AsyncProcess(const Transport& handle, string_view arg) : handle(handle), arg(arg) {}
+
+    void run() noexcept override
+    {
+        shared_ptr<AsyncProcess> op = move(self);
+        // Drop the handle before completing, so a caller woken by the
+        // result sees the Impl's use_count without this call in it.
+        try {
+            string result;
+            {
+                Transport h = move(handle);
+                result = h.process(arg);
+            }
+            set_value(move(result));
+        } catch (...) {
+            set_exception(current_exception());
+        }
+    }
+};
+
+}
+
+bool Transport::configure_async(const AsyncOptions& opts)
+{
+    return WorkPool::configure(opts.threads, opts.pin_workers);
+}
+
+size_t Transport::numa_nodes()
+{
+    return cpu_topology().nodes();
+}
+
+TransportFuture<string> Transport::process_async(string_view arg)
+{
+    // A closed handle throws here rather than from the pool.
+    if (checked_impl().is_confined())
+        throw logic_error("process_async on a thread_confined handle");
+    auto op = make_shared<AsyncProcess>(*this, arg);
+    op->self = op;
+    WorkPool::shared().submit(*op);
+    return TransportFuture<string>(move(op));
 }
 
 void Transport::process_with_callable(function<Uuid (size_t)> func)
 {
-    pImpl->process_with_callable(func);
+    TRANSPORT_TRACE_SCOPE("Transport::process_with_callable", pImpl.get(), 0);
+    checked_impl().process_with_callable(FunctionRef<Uuid (size_t)>(func));
+}
+
+void Transport::process_with_callable(FunctionRef<Uuid (size_t)> func)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_with_callable", pImpl.get(), 0);
+    checked_impl().process_with_callable(func);
+}
+
+void Transport::process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Uuid>)> fill)
+{
+    TRANSPORT_TRACE_SCOPE("Transport::process_with_callable_range", pImpl.get(), count);
+    checked_impl().process_with_callable_range(first, count, fill);
+}
+
+bool Transport::warm()
+{
+    TRANSPORT_TRACE_SCOPE("Transport::warm", pImpl.get(), 0);
+    return pImpl && pImpl->warm();
+}
+
+size_t Transport::total_processed() const
+{
+    return checked_impl().total_processed();
+}
+
+Transport::QueueStats Transport::queue_stats() const
+{
+    return checked_impl().queue_stats();
+}
+
+Transport::Stats Transport::stats() const
+{
+    return checked_impl().stats();
+}
+
+Transport::CacheStats Transport::cache_stats() const
+{
+    return checked_impl().cache_stats();
+}
+
+unsigned Transport::capabilities() const
+{
+    return checked_impl().capabilities();
 }
\ No newline at end of file
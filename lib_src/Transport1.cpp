@@ -0,0 +1,87 @@
+#include "TransportBackend.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+// Loadable backend for "echo://" names: every result is the argument itself.
+struct EchoImpl : public Transport::Impl {
+    atomic<size_t> calls{0};
+
+    string process(string_view arg)
+    {
+        calls.fetch_add(1, memory_order_relaxed);
+        return string(arg);
+    }
+
+    string process_owned(string&& arg)
+    {
+        calls.fetch_add(1, memory_order_relaxed);
+        return move(arg);
+    }
+
+    void process_into(string_view arg, string& out)
+    {
+        calls.fetch_add(1, memory_order_relaxed);
+        out.assign(arg);
+    }
+
+    void process_into(string_view arg, pmr::string& out)
+    {
+        calls.fetch_add(1, memory_order_relaxed);
+        out.assign(arg);
+    }
+
+    void process_batch(span<const string_view> args, vector<string>& out)
+    {
+        calls.fetch_add(args.size(), memory_order_relaxed);
+        out.resize(args.size());
+        for (size_t i = 0; i < args.size(); i++)
+            out[i].assign(args[i]);
+    }
+
+    void process_with_callable(FunctionRef<Transport::Uuid (size_t)> func)
+    {
+        func(0);
+    }
+
+    void process_with_callable_range(size_t first, size_t count, FunctionRef<void (size_t, span<Transport::Uuid>)> fill)
+    {
+        static constexpr size_t chunk = 256;
+        vector<Transport::Uuid> buf(min(count, chunk));
+        for (size_t done = 0; done < count; ) {
+            span<Transport::Uuid> out(buf.data(), min(count - done, chunk));
+            fill(first + done, out);
+            done += out.size();
+        }
+    }
+
+    size_t total_processed() const
+    {
+        return calls.load(memory_order_relaxed);
+    }
+
+    unsigned capabilities() const
+    {
+        return Transport::idempotent;
+    }
+};
+
+static IntrusivePtr<Transport::Impl> echo_factory(TransportError&, string_view, const Transport::Options&, pmr::memory_resource*)
+{
+    return make_intrusive<EchoImpl>();
+}
+
+// Runs the hot path once so its code and allocator pages are resident.
+static void echo_warm()
+{
+    string out;
+    EchoImpl().process_into("warm", out);
+}
+
+extern "C" const TransportBackend* transport_backend()
+{
+    static const TransportBackend backend = { "echo", echo_factory, echo_warm };
+    return &backend;
+}
@@ -0,0 +1,127 @@
+#include "TransportBackend.h"
+#include "TransportLog.h"
+#include <atomic>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+IntrusivePtr<Transport::Impl> TransportImpl_factory(TransportError& error, string_view name, const Transport::Options& opts,
+                                                    pmr::memory_resource* resource);
+
+namespace {
+
+struct Registry {
+    mutex lock;
+    map<string, TransportBackend, less<>> backends;
+    // Bumped on every change so per-thread caches know to look again.
+    atomic<size_t> generation{1};
+    once_flag env_loaded;
+};
+
+// Never destroyed: loaded libraries are never unloaded either.
+Registry& registry()
+{
+    static Registry* r = new Registry;
+    return *r;
+}
+
+struct LookupCache {
+    size_t generation = 0;
+    string scheme;
+    TransportFactory factory = nullptr;
+};
+
+thread_local LookupCache cache;
+
+}
+
+bool TransportBackends::add(const TransportBackend& backend)
+{
+    auto& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    if (!r.backends.emplace(backend.scheme, backend).second)
+        return false;
+    r.generation.fetch_add(1, memory_order_release);
+    return true;
+}
+
+bool TransportBackends::load(const string& path, string& error)
+{
+    void* lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!lib) {
+        error = dlerror();
+        return false;
+    }
+
+    // On failure the library is closed again; the error is built first, as
+    // the backend's strings live in it. A second load of a library that is
+    // already registered only drops the extra reference dlopen took.
+    auto entry = reinterpret_cast<const TransportBackend* (*)()>(dlsym(lib, TRANSPORT_BACKEND_SYMBOL));
+    if (!entry) {
+        error = path + ": no " TRANSPORT_BACKEND_SYMBOL " entry point";
+        dlclose(lib);
+        return false;
+    }
+
+    const TransportBackend* backend = entry();
+    if (!backend) {
+        error = path + ": " TRANSPORT_BACKEND_SYMBOL " returned no backend";
+        dlclose(lib);
+        return false;
+    }
+    if (!add(*backend)) {
+        error = path + ": scheme " + backend->scheme + " already registered";
+        dlclose(lib);
+        return false;
+    }
+    if (backend->warm)
+        backend->warm();
+    return true;
+}
+
+void TransportBackends::load_env()
+{
+    call_once(registry().env_loaded, [] {
+        const char* list = getenv("TRANSPORT_BACKENDS");
+        if (!list)
+            return;
+
+        string_view rest = list;
+        while (!rest.empty()) {
+            size_t end = rest.find(':');
+            string path(rest.substr(0, end));
+            rest = end == string_view::npos ? string_view() : rest.substr(end + 1);
+
+            string error;
+            if (!path.empty() && !load(path, error))
+                TRANSPORT_LOG(error, "{}", error);
+        }
+    });
+}
+
+TransportFactory TransportBackends::find(string_view name, string_view& rest)
+{
+    size_t sep = name.find("://");
+    if (sep == string_view::npos) {
+        rest = name;
+        return TransportImpl_factory;
+    }
+
+    string_view scheme = name.substr(0, sep);
+    rest = name.substr(sep + 3);
+
+    auto& r = registry();
+    if (cache.generation == r.generation.load(memory_order_acquire) && cache.scheme == scheme)
+        return cache.factory;
+
+    load_env();
+    lock_guard<mutex> guard(r.lock);
+    auto it = r.backends.find(scheme);
+    cache.generation = r.generation.load(memory_order_relaxed);
+    cache.scheme = scheme;
+    cache.factory = it == r.backends.end() ? nullptr : it->second.factory;
+    return cache.factory;
+}
@@ -1,44 +1,9 @@
-#include "Transport.h"
-#include <iostream>
-#include <sstream>
+#include "MyImpl.h"
 
 using namespace std;
 
-struct MyImpl : public Transport::Impl {
-    string data;
-    size_t  counter;
-
-    MyImpl(string& fail_desc, const string& name) {
-        if (name == "fail") {
-            fail_desc = "got fail for name";
-            return;
-        }
-
-        data = name;
-        counter = 0;
-        cout << __PRETTY_FUNCTION__ << ' ' << __FILE__ << ' ' << data << ' ' << counter << endl;
-    }
-
-    ~MyImpl()
-    {
-        cout << __PRETTY_FUNCTION__ << ' ' << __FILE__ << ' ' << data << ' ' << counter << endl;
-    }
-
-    string process(const string& arg)
-    {
-        stringstream ss;
-        ss << data << '+' << arg << '+' << counter;
-        counter++;
-        return ss.str();
-    }
-
-    void process_with_callable(function<string (size_t)> func)
-    {
-        cout << __PRETTY_FUNCTION__ << ' ' << __FILE__ << " got " << func(345) << " from callable" << endl;
-    }
-};
-
-shared_ptr<Transport::Impl> TransportImpl_factory(string& fail_desc, const string& name)
+IntrusivePtr<Transport::Impl> TransportImpl_factory(TransportError& error, string_view name, const Transport::Options& opts,
+                                                    pmr::memory_resource* resource)
 {
-    return make_shared<MyImpl>(fail_desc, name);
+    return MyImpl::create(error, name, opts, resource);
 }
\ No newline at end of file
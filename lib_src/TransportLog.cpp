@@ -0,0 +1,170 @@
+#include "TransportLog.h"
+#include "MpscRing.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+static atomic<LogSink*> current_sink{nullptr};
+static atomic<int> current_level{int(LogLevel::trace)};
+
+void set_log_sink(LogSink* sink)
+{
+    current_sink.store(sink, memory_order_release);
+}
+
+void set_log_level(LogLevel level)
+{
+    current_level.store(int(level), memory_order_relaxed);
+}
+
+bool log_enabled(LogLevel level)
+{
+    return int(level) >= current_level.load(memory_order_relaxed) && current_sink.load(memory_order_relaxed);
+}
+
+void log_write(LogLevel level, const char* where, const char* file, const char* msg, initializer_list<LogArg> args)
+{
+    LogSink* sink = current_sink.load(memory_order_acquire);
+    if (!sink)
+        return;
+
+    LogRecord rec;
+    rec.level = level;
+    rec.where = where;
+    rec.file = file;
+    rec.msg = msg;
+    rec.nargs = (unsigned char)min(args.size(), LogRecord::max_args);
+    copy_n(args.begin(), rec.nargs, rec.args);
+    sink->write(rec);
+}
+
+static void append_arg(const LogArg& arg, string& out)
+{
+    switch (arg.kind) {
+    case LogArg::u64: {
+        char digits[20];
+        out.append(digits, to_chars(digits, digits + sizeof(digits), arg.u).ptr);
+        break;
+    }
+    case LogArg::i64: {
+        char digits[20];
+        out.append(digits, to_chars(digits, digits + sizeof(digits), arg.i).ptr);
+        break;
+    }
+    case LogArg::str:
+        out.append(arg.s, arg.len);
+        break;
+    case LogArg::uuid: {
+        char text[Uuid128::text_size];
+        arg.id.format(text);
+        out.append(text, sizeof(text));
+        break;
+    }
+    case LogArg::none:
+        break;
+    }
+}
+
+void format_log_record(const LogRecord& rec, string& out)
+{
+    out.append(rec.where).append(1, ' ').append(rec.file).append(1, ' ');
+
+    string_view msg = rec.msg;
+    size_t next = 0;
+    for (size_t pos; (pos = msg.find("{}")) != string_view::npos; msg.remove_prefix(pos + 2)) {
+        out.append(msg.substr(0, pos));
+        if (next < rec.nargs)
+            append_arg(rec.args[next++], out);
+    }
+    out.append(msg);
+}
+
+struct StreamLogSink::State {
+    mutex lock;
+    ostream& os;
+    string line;
+};
+
+StreamLogSink::StreamLogSink(ostream& os) : state(new State{ {}, os, {} })
+{
+}
+
+StreamLogSink::~StreamLogSink() = default;
+
+void StreamLogSink::write(const LogRecord& rec)
+{
+    lock_guard<mutex> guard(state->lock);
+    state->line.clear();
+    format_log_record(rec, state->line);
+    state->line.push_back('\n');
+    state->os.write(state->line.data(), state->line.size());
+}
+
+struct AsyncLogSink::State {
+    LogSink& backend;
+    MpscRing<LogRecord> ring;
+    atomic<unsigned> wake{0};
+    atomic<bool> stopping{false};
+    atomic<size_t> written{0};
+    atomic<size_t> dropped{0};
+    thread worker;
+
+    State(LogSink& backend, size_t capacity) : backend(backend), ring(capacity), worker([this] { run(); }) {}
+
+    void run()
+    {
+        LogRecord rec;
+        for (;;) {
+            unsigned seen = wake.load(memory_order_acquire);
+            bool any = false;
+            while (ring.try_pop(rec)) {
+                backend.write(rec);
+                written.fetch_add(1, memory_order_release);
+                any = true;
+            }
+            if (any)
+                continue;
+            if (stopping.load(memory_order_acquire) && ring.size() == 0)
+                return;
+            wake.wait(seen, memory_order_acquire);
+        }
+    }
+};
+
+AsyncLogSink::AsyncLogSink(LogSink& backend, size_t capacity) : state(new State(backend, capacity))
+{
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    state->stopping.store(true, memory_order_release);
+    state->wake.fetch_add(1, memory_order_release);
+    state->wake.notify_one();
+    state->worker.join();
+}
+
+void AsyncLogSink::write(const LogRecord& rec)
+{
+    if (!state->ring.try_push(rec)) {
+        state->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    state->wake.fetch_add(1, memory_order_release);
+    state->wake.notify_one();
+}
+
+void AsyncLogSink::flush()
+{
+    size_t target = state->ring.pushed();
+    while (state->written.load(memory_order_acquire) < target)
+        this_thread::yield();
+}
+
+size_t AsyncLogSink::dropped() const
+{
+    return state->dropped.load(memory_order_relaxed);
+}
@@ -0,0 +1,222 @@
+#include "TransportTrace.h"
+#include "ThreadShard.h"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static atomic<TraceSink*> current_sink{nullptr};
+
+void set_trace_sink(TraceSink* sink)
+{
+    current_sink.store(sink, memory_order_release);
+}
+
+TraceSink* trace_sink()
+{
+    return current_sink.load(memory_order_acquire);
+}
+
+namespace {
+
+struct TraceRecord {
+    const char* name;
+    char phase;
+    uint64_t handle;
+    uint64_t arg_size;
+    uint64_t ns;
+};
+
+// Single-producer, single-consumer: the owning thread pushes, the sink's
+// writer pops.
+struct TraceBuffer {
+    vector<TraceRecord> slots;
+    size_t mask;
+    size_t tid;
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) atomic<size_t> tail{0};
+    // Set when the owning thread exits; the writer drops the buffer once empty.
+    atomic<bool> orphaned{false};
+
+    TraceBuffer(size_t capacity, size_t tid) : slots(capacity), mask(capacity - 1), tid(tid) {}
+
+    bool try_push(const TraceRecord& rec)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) == slots.size())
+            return false;
+        slots[h & mask] = rec;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool try_pop(TraceRecord& rec)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire))
+            return false;
+        rec = slots[t & mask];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+// The calling thread's buffer, and the sink it belongs to. Sinks are told
+// apart by a serial number, since a new one may reuse an old one's address.
+struct LocalBuffer {
+    uint64_t sink_id = 0;
+    shared_ptr<TraceBuffer> buf;
+
+    ~LocalBuffer()
+    {
+        if (buf)
+            buf->orphaned.store(true, memory_order_release);
+    }
+};
+
+thread_local LocalBuffer local_buffer;
+atomic<uint64_t> next_sink_id{1};
+
+size_t round_up_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+}
+
+struct ChromeTraceSink::State {
+    ostream& os;
+    size_t capacity;
+    uint64_t id = next_sink_id.fetch_add(1, memory_order_relaxed);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atomic<size_t> dropped{0};
+    atomic<bool> stopping{false};
+
+    mutex buffers_lock;
+    vector<shared_ptr<TraceBuffer>> buffers;
+
+    // Held while draining, by the writer thread or flush().
+    mutex write_lock;
+    bool first = true;
+    string line;
+    thread writer;
+
+    State(ostream& os, size_t capacity) : os(os), capacity(round_up_pow2(capacity ? capacity : 1))
+    {
+        os << "{\"traceEvents\":[";
+        writer = thread([this] { run(); });
+    }
+
+    TraceBuffer& local()
+    {
+        LocalBuffer& lb = local_buffer;
+        if (lb.sink_id != id) {
+            if (lb.buf)
+                lb.buf->orphaned.store(true, memory_order_release);
+            lb.buf = make_shared<TraceBuffer>(capacity, thread_shard_index());
+            lb.sink_id = id;
+            lock_guard<mutex> guard(buffers_lock);
+            buffers.push_back(lb.buf);
+        }
+        return *lb.buf;
+    }
+
+    void run()
+    {
+        while (!stopping.load(memory_order_acquire)) {
+            drain();
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        drain();
+    }
+
+    void drain()
+    {
+        vector<shared_ptr<TraceBuffer>> snapshot;
+        {
+            lock_guard<mutex> guard(buffers_lock);
+            snapshot = buffers;
+        }
+
+        lock_guard<mutex> guard(write_lock);
+        TraceRecord rec;
+        for (auto& buf : snapshot) {
+            while (buf->try_pop(rec))
+                write(rec, buf->tid);
+        }
+        os.flush();
+
+        lock_guard<mutex> reap(buffers_lock);
+        erase_if(buffers, [](const shared_ptr<TraceBuffer>& buf) {
+            return buf->orphaned.load(memory_order_acquire) && buf->tail.load(memory_order_relaxed) == buf->head.load(memory_order_acquire);
+        });
+    }
+
+    // ts is in microseconds, as the format expects.
+    void write(const TraceRecord& rec, size_t tid)
+    {
+        char num[24];
+        auto append = [&](uint64_t v, int base = 10) { line.append(num, to_chars(num, num + sizeof(num), v, base).ptr); };
+
+        line.clear();
+        line.append(first ? "\n" : ",\n");
+        first = false;
+        line.append("{\"name\":\"").append(rec.name).append("\",\"ph\":\"").append(1, rec.phase).append("\",\"ts\":");
+        append(rec.ns / 1000);
+        line.append(1, '.');
+        uint64_t frac = rec.ns % 1000;
+        line.append(frac < 100 ? (frac < 10 ? "00" : "0") : "");
+        append(frac);
+        // Instant events are drawn on their thread's track.
+        if (rec.phase == 'i')
+            line.append(",\"s\":\"t\"");
+        line.append(",\"pid\":1,\"tid\":");
+        append(tid);
+        line.append(",\"args\":{\"handle\":\"0x");
+        append(rec.handle, 16);
+        line.append("\"");
+        if (rec.phase != 'E') {
+            line.append(",\"arg_size\":");
+            append(rec.arg_size);
+        }
+        line.append("}}");
+        os.write(line.data(), line.size());
+    }
+};
+
+ChromeTraceSink::ChromeTraceSink(ostream& os, size_t per_thread_capacity) : state(new State(os, per_thread_capacity))
+{
+}
+
+ChromeTraceSink::~ChromeTraceSink()
+{
+    state->stopping.store(true, memory_order_release);
+    state->writer.join();
+    state->os << "\n]}\n";
+    state->os.flush();
+}
+
+void ChromeTraceSink::event(const char* name, char phase, uint64_t handle, uint64_t arg_size)
+{
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - state->start).count();
+    if (!state->local().try_push({ name, phase, handle, arg_size, ns }))
+        state->dropped.fetch_add(1, memory_order_relaxed);
+}
+
+void ChromeTraceSink::flush()
+{
+    state->drain();
+}
+
+size_t ChromeTraceSink::dropped() const
+{
+    return state->dropped.load(memory_order_relaxed);
+}
@@ -0,0 +1,174 @@
+#include "WorkPool.h"
+#include "CpuTopology.h"
+#include <algorithm>
+
+using namespace std;
+
+static thread_local WorkPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+WorkPool::WorkPool(size_t count, bool pin)
+{
+    if (count == 0)
+        count = max(1u, thread::hardware_concurrency());
+
+    vector<int> cpus;
+    if (pin)
+        cpus = cpu_topology().all_cpus();
+    for (size_t i = 0; i < count; i++)
+        workers.push_back(make_unique<Worker>());
+    for (size_t i = 0; i < count; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        threads.emplace_back([this, i, cpu] {
+            if (cpu >= 0)
+                pin_current_thread({ cpu });
+            run(i);
+        });
+    }
+}
+
+WorkPool::~WorkPool()
+{
+    stopping.store(true, memory_order_seq_cst);
+    wake.fetch_add(1, memory_order_seq_cst);
+    wake.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void WorkPool::Worker::push_front(Task& task)
+{
+    task.prev = nullptr;
+    task.next = front;
+    if (front)
+        front->prev = &task;
+    else
+        back = &task;
+    front = &task;
+}
+
+void WorkPool::Worker::push_back(Task& task)
+{
+    task.next = nullptr;
+    task.prev = back;
+    if (back)
+        back->next = &task;
+    else
+        front = &task;
+    back = &task;
+}
+
+WorkPool::Task* WorkPool::Worker::pop_front()
+{
+    Task* task = front;
+    if (task) {
+        front = task->next;
+        if (front)
+            front->prev = nullptr;
+        else
+            back = nullptr;
+    }
+    return task;
+}
+
+WorkPool::Task* WorkPool::Worker::pop_back()
+{
+    Task* task = back;
+    if (task) {
+        back = task->prev;
+        if (back)
+            back->next = nullptr;
+        else
+            front = nullptr;
+    }
+    return task;
+}
+
+void WorkPool::submit(Task& task)
+{
+    if (current_pool == this) {
+        Worker& own = *workers[current_worker];
+        lock_guard<mutex> guard(own.lock);
+        own.push_back(task);
+    } else {
+        // Outside submissions go in at the front, so the owner, which takes
+        // from the back, runs them in submission order.
+        Worker& target = *workers[next.fetch_add(1, memory_order_relaxed) % workers.size()];
+        lock_guard<mutex> guard(target.lock);
+        target.push_front(task);
+    }
+
+    wake.fetch_add(1, memory_order_seq_cst);
+    if (idle.load(memory_order_seq_cst))
+        wake.notify_one();
+}
+
+WorkPool::Task* WorkPool::find_task(size_t self)
+{
+    {
+        Worker& own = *workers[self];
+        lock_guard<mutex> guard(own.lock);
+        if (Task* task = own.pop_back())
+            return task;
+    }
+
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (Task* task = victim.pop_front())
+            return task;
+    }
+    return nullptr;
+}
+
+void WorkPool::run(size_t self)
+{
+    current_pool = this;
+    current_worker = self;
+
+    for (;;) {
+        if (Task* task = find_task(self)) {
+            task->run();
+            continue;
+        }
+
+        // Announce idleness before the final check so that a concurrent
+        // submit either sees us idle or we see its task.
+        unsigned seen = wake.load(memory_order_seq_cst);
+        idle.fetch_add(1, memory_order_seq_cst);
+        if (Task* task = find_task(self)) {
+            idle.fetch_sub(1, memory_order_seq_cst);
+            task->run();
+            continue;
+        }
+        if (stopping.load(memory_order_seq_cst)) {
+            idle.fetch_sub(1, memory_order_seq_cst);
+            return;
+        }
+        wake.wait(seen, memory_order_seq_cst);
+        idle.fetch_sub(1, memory_order_seq_cst);
+    }
+}
+
+static atomic<size_t> configured_threads{0};
+static atomic<bool> configured_pin{false};
+static atomic<bool> shared_created{false};
+
+WorkPool& WorkPool::shared()
+{
+    // Never destroyed: tasks may still be completing while the process exits.
+    static WorkPool* pool = [] {
+        shared_created.store(true);
+        return new WorkPool(configured_threads.load(), configured_pin.load());
+    }();
+    return *pool;
+}
+
+bool WorkPool::configure(size_t threads, bool pin)
+{
+    if (shared_created.load())
+        return false;
+    configured_threads.store(threads);
+    configured_pin.store(pin);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool backing Transport::process_async. Every worker owns a
+// deque and takes from its back: tasks submitted from a worker are pushed
+// there and run LIFO, while other threads submit round-robin to the fronts
+// and so run FIFO. Idle workers steal from the fronts of the others. Idle workers sleep on an atomic wait, and a submit only
+// issues a wake-up while some worker is idle.
+class WorkPool {
+public:
+    // Intrusive node for one unit of work: the pool links the node itself
+    // into a worker's list, so submitting never allocates. The submitter
+    // keeps it alive until run() returns; run() may free it.
+    class Task {
+    public:
+        virtual void run() noexcept = 0;
+
+    protected:
+        ~Task() = default;
+
+    private:
+        friend class WorkPool;
+        Task* prev = nullptr;
+        Task* next = nullptr;
+    };
+
+    // With pin, worker i runs only on the i-th CPU, node by node.
+    explicit WorkPool(size_t threads, bool pin = false);
+    ~WorkPool();
+
+    void submit(Task& task);
+    size_t size() const { return workers.size(); }
+
+    // Process-wide pool, created on first use with the configured size.
+    static WorkPool& shared();
+    // Only takes effect before the first shared() call; returns whether it did.
+    static bool configure(size_t threads, bool pin = false);
+
+private:
+    // Doubly linked, so the owner can pop the back while thieves pop the front.
+    struct Worker {
+        std::mutex lock;
+        Task* front = nullptr;
+        Task* back = nullptr;
+
+        void push_front(Task& task);
+        void push_back(Task& task);
+        Task* pop_front();
+        Task* pop_back();
+    };
+
+    Task* find_task(size_t self);
+    void run(size_t self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next{0};
+    std::atomic<unsigned> wake{0};
+    std::atomic<size_t> idle{0};
+    std::atomic<bool> stopping{false};
+};
@@ -0,0 +1,212 @@
+#include "LatencyHistogram.h"
+#include "Transport.h"
+#include "TransportRecord.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Replays a log written through Options::recorder at full speed. Arguments
+// are passed to process_into straight out of the mapping. Record i goes to
+// thread i % threads, so each thread keeps the original order of its share.
+//
+//   transport_replay LOG [--threads=N] [--loops=N] [--verify]
+//
+// --verify compares each result, and the handle's total_processed() after
+// the call, with the recorded ones; that only holds for a single-threaded
+// replay against freshly opened handles.
+
+struct Record {
+    string_view name;
+    string_view arg;
+    string_view result;
+    uint64_t duration_ns;
+    uint64_t processed;
+};
+
+struct Mapping {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    ~Mapping()
+    {
+        if (data)
+            munmap(const_cast<char*>(data), size);
+    }
+};
+
+static bool map_log(const char* path, Mapping& mapping)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) {
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = p != MAP_FAILED;
+        if (ok) {
+            mapping.data = static_cast<const char*>(p);
+            mapping.size = size_t(st.st_size);
+            madvise(p, mapping.size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+// Indexes the records without copying any of their bytes; false if the log
+// is truncated or not a log at all.
+static bool index_log(const Mapping& mapping, vector<Record>& records)
+{
+    if (mapping.size < sizeof(transport_record_magic) || memcmp(mapping.data, transport_record_magic, sizeof(transport_record_magic)) != 0)
+        return false;
+
+    size_t pos = sizeof(transport_record_magic);
+    while (pos < mapping.size) {
+        TransportRecordHeader h;
+        if (mapping.size - pos < sizeof(h))
+            return false;
+        memcpy(&h, mapping.data + pos, sizeof(h));
+        pos += sizeof(h);
+        if (mapping.size - pos < h.payload_size())
+            return false;
+
+        const char* p = mapping.data + pos;
+        Record r;
+        r.name = string_view(p, h.name_len);
+        r.arg = string_view(p + h.name_len, h.arg_len);
+        r.result = string_view(p + h.name_len + h.arg_len, h.result_len);
+        r.duration_ns = h.duration_ns;
+        r.processed = h.processed;
+        records.push_back(r);
+        pos += h.payload_size();
+    }
+    return true;
+}
+
+static void print_latency(const char* label, const LatencyHistogram& h)
+{
+    printf("%-10s p50 %8llu ns  p90 %8llu ns  p99 %8llu ns  p99.9 %8llu ns\n", label,
+           (unsigned long long)h.percentile(0.5), (unsigned long long)h.percentile(0.9),
+           (unsigned long long)h.percentile(0.99), (unsigned long long)h.percentile(0.999));
+}
+
+int main(int argc, char *argv[])
+{
+    const char* path = nullptr;
+    size_t threads = 1;
+    size_t loops = 1;
+    bool verify = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = max<size_t>(1, strtoul(argv[i] + 10, nullptr, 10));
+        else if (strncmp(argv[i], "--loops=", 8) == 0)
+            loops = max<size_t>(1, strtoul(argv[i] + 8, nullptr, 10));
+        else if (strcmp(argv[i], "--verify") == 0)
+            verify = true;
+        else
+            path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s LOG [--threads=N] [--loops=N] [--verify]\n", argv[0]);
+        return 2;
+    }
+
+    Mapping mapping;
+    vector<Record> records;
+    if (!map_log(path, mapping) || !index_log(mapping, records)) {
+        fprintf(stderr, "%s: not a readable transport log\n", path);
+        return 1;
+    }
+
+    // One handle per recorded name, shared by every thread as in production.
+    map<string_view, Transport> handles;
+    vector<Transport*> handle_of(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        auto it = handles.find(records[i].name);
+        if (it == handles.end())
+            it = handles.emplace(records[i].name, Transport(records[i].name)).first;
+        if (!it->second.is_open()) {
+            fprintf(stderr, "cannot open %.*s: %s\n", int(records[i].name.size()), records[i].name.data(), it->second.open_error().c_str());
+            return 1;
+        }
+        handle_of[i] = &it->second;
+    }
+
+    LatencyHistogram recorded;
+    for (const Record& r : records)
+        recorded.record(r.duration_ns);
+
+    vector<LatencyHistogram> replayed(threads);
+    vector<size_t> mismatches(threads);
+    vector<size_t> counter_mismatches(threads);
+    atomic<size_t> ready{0};
+    atomic<bool> go{false};
+
+    auto body = [&](size_t t) {
+        string out;
+        ready.fetch_add(1);
+        while (!go.load(memory_order_acquire))
+            this_thread::yield();
+        for (size_t loop = 0; loop < loops; loop++) {
+            for (size_t i = t; i < records.size(); i += threads) {
+                auto start = chrono::steady_clock::now();
+                handle_of[i]->process_into(records[i].arg, out);
+                auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+                replayed[t].record(uint64_t(ns));
+                if (verify && loop == 0) {
+                    if (out != records[i].result)
+                        mismatches[t]++;
+                    if (handle_of[i]->total_processed() != records[i].processed)
+                        counter_mismatches[t]++;
+                }
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(body, t);
+    while (ready.load() + 1 < threads)
+        this_thread::yield();
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    body(0);
+    for (auto& w : workers)
+        w.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    LatencyHistogram total;
+    size_t mismatched = 0;
+    size_t counter_mismatched = 0;
+    for (size_t t = 0; t < threads; t++) {
+        total.merge(replayed[t]);
+        mismatched += mismatches[t];
+        counter_mismatched += counter_mismatches[t];
+    }
+
+    double calls = double(records.size()) * loops;
+    printf("records %zu, handles %zu, threads %zu, loops %zu\n", records.size(), handles.size(), threads, loops);
+    printf("replayed %.0f calls in %.3f s, %.0f calls/s\n", calls, seconds, seconds > 0 ? calls / seconds : 0);
+    print_latency("recorded", recorded);
+    print_latency("replayed", total);
+    if (verify)
+        printf("result mismatches %zu, counter mismatches %zu\n", mismatched, counter_mismatched);
+    return mismatched || counter_mismatched ? 1 : 0;
+}
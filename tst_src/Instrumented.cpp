@@ -0,0 +1,113 @@
+#include "Instrumented.h"
+#include "AllocCount.h"
+#include "PerfCounters.h"
+#include "Transport.h"
+
+#include <cstdio>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Scenario {
+    const char* name;
+    // Most heap allocations allowed per call; negative means report only.
+    double alloc_budget;
+    function<void ()> call;
+};
+
+constexpr size_t warmup_calls = 100;
+constexpr size_t measured_calls = 10000;
+
+}
+
+// Runs each scenario warm, then counts the calling thread's heap
+// allocations and, where the kernel allows, hardware events over a fixed
+// number of calls. Logging is off, as nothing installs a sink in this mode.
+int run_instrumented()
+{
+    Transport handle("instr");
+    string out;
+    // Outgrowing the buffer would fall back to the heap and show up.
+    char arena_buf[4096];
+    pmr::monotonic_buffer_resource arena(arena_buf, sizeof(arena_buf));
+    pmr::string arena_out(&arena);
+    string_view batch[] = { "a", "b", "c", "d" };
+    vector<string> batch_out;
+    string_view parts[] = { "hdr:", "body:", "end" };
+    TransportFragments fragments;
+    string long_arg(64, 'l');
+    size_t seed = 7;
+
+    vector<Scenario> scenarios;
+    scenarios.push_back({ "process_into", 0, [&] { handle.process_into("x", out); } });
+    scenarios.push_back({ "process_into/pmr", 0, [&] { handle.process_into("x", arena_out); } });
+    scenarios.push_back({ "process/short", 0, [&] { handle.process("x"); } });
+    scenarios.push_back({ "process/long", 1, [&] { handle.process(long_arg); } });
+    scenarios.push_back({ "process_batch/4", 0, [&] { handle.process_batch(batch, batch_out); } });
+    scenarios.push_back({ "process_fragments/3", 0, [&] { handle.process_fragments(parts, fragments); } });
+    scenarios.push_back({ "borrow/process_into", 0, [&] { handle.borrow().process_into("x", out); } });
+    scenarios.push_back({ "copy", 0, [&] { Transport copy = handle; } });
+    scenarios.push_back({ "process_with_callable", 0, [&] {
+        handle.process_with_callable([&seed](size_t arg) { return Transport::make_uuid(seed, arg); });
+    } });
+    // The Impl's chunk buffer is the one allocation.
+    scenarios.push_back({ "process_with_callable_range/64", 1, [&] {
+        handle.process_with_callable_range(0, 64, [&seed](size_t i) { return Transport::make_uuid(seed, i); });
+    } });
+    // Counts are per thread, so these only show the caller's share; for
+    // process_async that is the future state, which is also the pool node.
+    scenarios.push_back({ "process_async", 1, [&] { handle.process_async("x").get(); } });
+    scenarios.push_back({ "open_stream", -1, [&] {
+        TransportStream stream = handle.open_stream();
+        stream.finish("x");
+        char buf[64];
+        while (!stream.done())
+            stream.read(buf);
+    } });
+
+    PerfCounters perf;
+    printf("%-32s %10s %10s", "scenario", "allocs", "bytes");
+    for (const char* name : PerfCounters::names)
+        printf(" %14s", name);
+    printf("  budget\n");
+
+    size_t over_budget = 0;
+    for (auto& s : scenarios) {
+        for (size_t i = 0; i < warmup_calls; i++)
+            s.call();
+
+        AllocCount before = thread_alloc_count();
+        perf.start();
+        for (size_t i = 0; i < measured_calls; i++)
+            s.call();
+        perf.stop();
+        AllocCount used = thread_alloc_count() - before;
+
+        double allocs = double(used.allocs) / measured_calls;
+        printf("%-32s %10.2f %10.1f", s.name, allocs, double(used.bytes) / measured_calls);
+        for (int c = 0; c < PerfCounters::count; c++) {
+            if (perf.available(PerfCounters::Counter(c)))
+                printf(" %14.1f", double(perf.value(PerfCounters::Counter(c))) / measured_calls);
+            else
+                printf(" %14s", "n/a");
+        }
+        if (s.alloc_budget < 0) {
+            printf("  -\n");
+        } else if (allocs > s.alloc_budget) {
+            printf("  OVER (%.0f)\n", s.alloc_budget);
+            over_budget++;
+        } else {
+            printf("  ok (%.0f)\n", s.alloc_budget);
+        }
+    }
+
+    if (!perf.any_available())
+        printf("hardware counters unavailable (perf_event_open refused)\n");
+    printf("%zu scenarios, %zu over allocation budget\n", scenarios.size(), over_budget);
+    return over_budget ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// tst --instrumented: runs each API call in a loop and reports heap
+// allocations and hardware counters per call. Returns nonzero if any call
+// exceeds its allocation budget. Needs AllocCount.cpp linked in.
+int run_instrumented();
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware counters for the calling thread, user space only, through
+// perf_event_open. Each counter is opened on its own, so one the CPU or the
+// kernel doesn't offer (common in VMs and containers) only leaves that
+// counter unavailable.
+class PerfCounters {
+public:
+    enum Counter { cycles, instructions, l1d_misses, llc_misses, branch_misses, count };
+
+    static constexpr const char* names[count] = { "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses" };
+
+    PerfCounters()
+    {
+        open_counter(cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open_counter(instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open_counter(l1d_misses, PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        open_counter(llc_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        open_counter(branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    }
+
+    ~PerfCounters()
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(Counter c) const { return fds[c] >= 0; }
+
+    bool any_available() const
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    void start()
+    {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop()
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    // Zero for an unavailable counter.
+    std::uint64_t value(Counter c) const
+    {
+        std::uint64_t v = 0;
+        if (fds[c] < 0 || read(fds[c], &v, sizeof(v)) != sizeof(v))
+            return 0;
+        return v;
+    }
+
+private:
+    void open_counter(Counter c, std::uint32_t type, std::uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[c] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    int fds[count] = { -1, -1, -1, -1, -1 };
+};
@@ -0,0 +1,81 @@
+#include "Stress.h"
+#include "Transport.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Threads open and drop interned handles on a few names as fast as they
+// can, so opens keep racing the eviction of an Impl whose last handle has
+// just gone. Two handles held at once on one name must share the Impl.
+static size_t stress_open_shared(size_t threads, size_t rounds)
+{
+    static const char* names[] = { "stress1", "stress2", "stress3" };
+    atomic<size_t> failures{0};
+    atomic<bool> go{false};
+
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            while (!go.load(memory_order_acquire))
+                this_thread::yield();
+            string out;
+            for (size_t i = 0; i < rounds; i++) {
+                const char* name = names[(t + i) % 3];
+                Transport a = Transport::open_shared(name);
+                if (i % 4 == 0) {
+                    Transport b = Transport::open_shared(name);
+                    if (!a.is_same(b))
+                        failures.fetch_add(1, memory_order_relaxed);
+                }
+                a.process_into("s", out);
+                if (out.compare(0, 7, name) != 0)
+                    failures.fetch_add(1, memory_order_relaxed);
+            }
+        });
+    }
+    go.store(true, memory_order_release);
+    for (auto& w : workers)
+        w.join();
+    return failures.load();
+}
+
+// More callers than ring slots under Backpressure::block, so producers
+// keep parking on a full ring while completions race their return.
+static size_t stress_queue(size_t threads, size_t rounds)
+{
+    Transport::Options opts;
+    opts.queue_capacity = 2;
+    Transport handle("stressq", opts);
+    atomic<size_t> failures{0};
+
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            string out;
+            for (size_t i = 0; i < rounds; i++) {
+                handle.process_into("q", out);
+                if (out.compare(0, 7, "stressq") != 0)
+                    failures.fetch_add(1, memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    if (handle.total_processed() != threads * rounds)
+        failures.fetch_add(1, memory_order_relaxed);
+    return failures.load();
+}
+
+int run_stress()
+{
+    size_t failures = stress_open_shared(8, 20000);
+    printf("open_shared: %zu failures\n", failures);
+    size_t queue_failures = stress_queue(8, 20000);
+    printf("queue: %zu failures\n", queue_failures);
+    return failures || queue_failures ? 1 : 0;
+}
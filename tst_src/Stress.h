@@ -0,0 +1,6 @@
+#pragma once
+
+// tst --stress: hammers the process-wide tables and the queued layer from
+// several threads and returns nonzero if any check failed. Meant to be run
+// under a sanitizer.
+int run_stress();
@@ -1,7 +1,21 @@
+#include "BasicTransport.h"
+#include "Instrumented.h"
+#include "Stress.h"
+#include "MyImpl.h"
 #include "Transport.h"
+#include "TransportBackend.h"
+#include "TransportLog.h"
+#include "TransportRecord.h"
+#include "TransportTrace.h"
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory_resource>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/uio.h>
 
 using namespace std;
 
@@ -11,6 +25,21 @@ void func(Transport handle)
     cout << handle.process("f") << endl;
 }
 
+void func_ref(TransportRef handle)
+{
+    cout << handle.process("e") << endl;
+}
+
+// Prints counts only; latencies vary from run to run.
+struct PrintStatsExporter : Transport::StatsExporter {
+    void export_stats(string_view name, const Transport::Stats& stats) override
+    {
+        cout << "stats " << name << ": process calls=" << stats.process.calls << " bytes_in=" << stats.process.bytes_in
+             << " bytes_out=" << stats.process.bytes_out << " batch calls=" << stats.batch.calls
+             << " callable calls=" << stats.callable.calls << endl;
+    }
+};
+
 struct MyCallable {
     size_t data;
 
@@ -18,16 +47,26 @@ struct MyCallable {
 
     Transport::Uuid operator()(size_t arg)
     {
-        using namespace std;
-
-        stringstream ss;
-        ss << "MyCallable data=" << data << " arg=" << arg;
-        return ss.str();
+        return Transport::make_uuid(data, arg);
     }
 };
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && string_view(argv[1]) == "--instrumented")
+        return run_instrumented();
+    if (argc > 1 && string_view(argv[1]) == "--stress")
+        return run_stress();
+
+    // Synchronous, so log lines stay in order with the rest of the output.
+    StreamLogSink console(cout);
+    set_log_sink(&console);
+#if TRANSPORT_TRACE
+    ofstream trace_file("transport_trace.json");
+    ChromeTraceSink trace(trace_file);
+    set_trace_sink(&trace);
+#endif
+
     cout << "top of main" << endl;
 
     {
@@ -40,22 +79,280 @@ int main(int argc, char *argv[])
         cout << handle1.process("c") << endl;
         cout << handle1.process("d") << endl;
 
+        string out;
+        handle1.process_into("into", out);
+        cout << out << endl;
+
+        string_view batch[] = { "x", "y", "z" };
+        vector<string> results;
+        handle1.process_batch(batch, results);
+        for (auto& r : results)
+            cout << r << endl;
+
+        vector<TransportFuture<string>> pending;
+        for (const char* arg : { "async1", "async2", "async3" })
+            pending.push_back(handle1.process_async(arg));
+        for (auto& f : pending)
+            cout << f.get() << endl;
+
         cout << "inside use_count=" << handle1.use_count() << endl;
+        func_ref(handle1.borrow());
         cout << "is handle1 == handle2 = " << handle1.is_same(handle2) << endl;
 
+        // Moving hands the reference over without touching the count.
+        func(move(handle2));
+        cout << "moved-from handle2.is_open()=" << handle2.is_open() << " use_count=" << handle1.use_count() << endl;
+        string payload = "owned";
+        cout << handle1.process(move(payload)) << endl;
+
         Transport handle3("handle3");
         cout << "is handle1 == handle3 = " << handle1.is_same(handle3) << endl;
 
-        handle3.process_with_callable([&](size_t arg) { stringstream ss; ss << "lambda" << arg; return ss.str(); });
+        handle3.process_with_callable([&](size_t arg) { return Transport::make_uuid(0x1a3bda, arg); });
 
         MyCallable policy1(1), policy2(2);
         handle3.process_with_callable(policy1);
         handle3.process_with_callable(policy2);
 
+        function<Transport::Uuid (size_t)> wrapped = policy1;
+        handle3.process_with_callable(wrapped);
+
+        handle3.process_with_callable_range(1000, 600, policy1);
+        handle3.process_with_callable_range(0, 10, [](size_t first, span<Transport::Uuid> out) {
+            for (size_t i = 0; i < out.size(); i++)
+                out[i] = Transport::make_uuid(0xb01c, first + i);
+        });
+
+        auto parsed = Uuid128::parse("0123abcd-0000-0000-0000-0000000000ff");
+        cout << "parsed uuid=" << *parsed << " lo=" << parsed->lo() << endl;
+
+        Transport::Options sharded;
+        sharded.sharded_counters = true;
+        Transport handle5("handle5", sharded);
+        vector<thread> workers;
+        for (int i = 0; i < 4; i++)
+            workers.emplace_back([copy = handle5]() mutable { for (int j = 0; j < 1000; j++) copy.process("w"); });
+        for (auto& w : workers)
+            w.join();
+        cout << handle5.process("g") << endl;
+        cout << "handle5.total_processed()=" << handle5.total_processed() << endl;
+
+        Transport::Options queued;
+        queued.queue_capacity = 256;
+        Transport handle6("handle6", queued);
+        workers.clear();
+        for (int i = 0; i < 4; i++)
+            workers.emplace_back([copy = handle6]() mutable { for (int j = 0; j < 1000; j++) copy.process("q"); });
+        for (auto& w : workers)
+            w.join();
+        cout << handle6.process("j") << endl;
+        auto qs = handle6.queue_stats();
+        cout << "handle6 enqueued=" << qs.enqueued << " dropped=" << qs.dropped << " capacity=" << qs.capacity << endl;
+
+        {
+            auto shared1 = Transport::open_shared("shared");
+            auto shared2 = Transport::open_shared("shared");
+            cout << "is shared1 == shared2 = " << shared1.is_same(shared2) << endl;
+            cout << shared2.process("h") << endl;
+        }
+        auto shared3 = Transport::open_shared("shared");
+        cout << shared3.process("i") << endl;
+
+        string load_error;
+        if (!TransportBackends::load(TRANSPORT1_PATH, load_error))
+            cout << "load_error=" << load_error << endl;
+        // Refused, and the extra reference is closed; the first load stays.
+        if (!TransportBackends::load(TRANSPORT1_PATH, load_error))
+            cout << "second load refused: " << load_error.substr(load_error.find("scheme")) << endl;
+        Transport echo("echo://handle7");
+        cout << "echo.process(\"k\")=" << echo.process("k") << endl;
+        Transport unknown("nope://handle8");
+        cout << "unknown.open_error()=" << unknown.open_error() << endl;
+
+        BasicTransport<MyImpl> direct("direct");
+        auto direct2 = direct;
+        cout << direct2.process("l") << " use_count=" << direct.use_count() << endl;
+        Transport erased = direct.to_transport();
+        cout << erased.process("m") << " use_count=" << direct.use_count() << endl;
+
+        {
+            // The Impl, its name and the result all live in buf; nothing is
+            // freed one by one.
+            char buf[2048];
+            pmr::monotonic_buffer_resource arena(buf, sizeof(buf));
+            Transport pooled("pooled", Transport::Options(), &arena);
+            pmr::string out(&arena);
+            pooled.process_into("n", out);
+            cout << out << endl;
+        }
+
+        // Name and argument are slices of one buffer; neither is copied to
+        // make the calls.
+        string_view received = "handle9 o";
+        Transport sliced(received.substr(0, 7));
+        cout << sliced.process(received.substr(8)) << endl;
+
+        {
+            PrintStatsExporter exporter;
+            Transport::set_stats_exporter(&exporter);
+            Transport::Options metered;
+            metered.metrics = true;
+            Transport handle11("handle11", metered);
+            handle11.process("r");
+            handle11.process("ss");
+            handle11.process_with_callable([](size_t arg) { return Transport::make_uuid(11, arg); });
+            Transport::export_stats();
+            auto stats = handle11.stats();
+            cout << "handle11 latency samples=" << stats.process.latency.count() << endl;
+            handle11 = Transport("handle12");
+            Transport::set_stats_exporter(nullptr);
+        }
+
+        {
+            // Output starts flowing before the argument is complete.
+            Transport handle13("handle13");
+            TransportStream stream = handle13.open_stream();
+            char buf[16];
+            string streamed;
+            for (string_view chunk : { "tu", "vw", "xyz" }) {
+                while (!stream.write(chunk))
+                    streamed.append(buf, stream.read(buf));
+                streamed.append(buf, stream.read(buf));
+                streamed.append(1, '|');
+            }
+            stream.finish();
+            while (!stream.done())
+                streamed.append(buf, stream.read(buf));
+            cout << streamed << endl;
+
+            Transport::Options cache_opts;
+            cache_opts.cache_capacity = 64;
+            Transport cached_echo("echo://cached", cache_opts);
+            for (string_view arg : { "a", "b", "a", "a" })
+                cached_echo.process(arg);
+            auto cs = cached_echo.cache_stats();
+            cout << "echo idempotent=" << bool(cached_echo.capabilities() & Transport::idempotent) << " cache hits=" << cs.hits
+                 << " misses=" << cs.misses << " size=" << cs.size << endl;
+
+            TransportStream echoed = echo.open_stream();
+            echoed.finish("buffered");
+            string out(16, '\0');
+            out.resize(echoed.read(out));
+            cout << "echo stream=" << out << endl;
+        }
+
+        {
+            // Header, body and trailer go in as they are, and the result goes
+            // out through writev without being joined first.
+            Transport handle14("handle14");
+            string_view message[] = { "hdr:", "body", ":end" };
+            TransportFragments result;
+            handle14.process_fragments(message, result);
+            vector<iovec> iov;
+            for (string_view part : result.parts())
+                iov.push_back({ const_cast<char*>(part.data()), part.size() });
+            iov.push_back({ const_cast<char*>("\n"), 1 });
+            cout << "fragments=" << result.parts().size() << " ";
+            cout.flush();
+            writev(1, iov.data(), int(iov.size()));
+        }
+
+        {
+            // Replay with: transport_replay <temp dir>/transport_record.bin --verify
+            string record_path = (filesystem::temp_directory_path() / "transport_record.bin").string();
+            TransportRecorder recorder(record_path);
+            Transport::Options recorded;
+            recorded.recorder = &recorder;
+            Transport handle15("handle15", recorded);
+            for (string_view arg : { "w", "x", "y" })
+                handle15.process(arg);
+            string_view batch[] = { "z1", "z2" };
+            vector<string> batch_out;
+            handle15.process_batch(batch, batch_out);
+            cout << "recorded " << recorder.records() << " calls" << endl;
+
+            // Cache hits don't move the backend's counter, so the batch's
+            // records all carry the total rather than one value each.
+            TransportRecorder cached_recorder((filesystem::temp_directory_path() / "transport_record_cached.bin").string());
+            Transport::Options cached;
+            cached.recorder = &cached_recorder;
+            cached.cache_capacity = 16;
+            Transport cached_echo("echo://recorded", cached);
+            cached_echo.process("c1");
+            string_view cached_batch[] = { "c1", "c2", "c1" };
+            cached_echo.process_batch(cached_batch, batch_out);
+            cout << "recorded " << cached_recorder.records() << " cached calls, total_processed="
+                 << cached_echo.total_processed() << endl;
+        }
+
         Transport handle4("fail");
         cout << "handle4.is_open()=" << handle4.is_open() << endl;
         cout << "handle4.open_error()=" << handle4.open_error() << endl;
+        try {
+            handle4.process("p");
+        } catch (const exception& e) {
+            cout << "handle4.process threw: " << e.what() << endl;
+        }
+
+        TransportError error;
+        if (!Transport::try_open("fail", error))
+            cout << "try_open(\"fail\") failed with error " << int(error) << ": " << transport_error_message(error) << endl;
+        if (auto opened = Transport::try_open("handle10", error))
+            cout << opened->process("q") << endl;
+
+        Transport::Options confined_opts;
+        confined_opts.thread_confined = true;
+        confined_opts.queue_capacity = 8;
+        if (!Transport::try_open("confined1", confined_opts, error))
+            cout << "try_open(\"confined1\") failed: " << transport_error_message(error) << endl;
+        confined_opts.queue_capacity = 0;
+        try {
+            Transport("confined2", confined_opts).process_async("s");
+        } catch (const logic_error& e) {
+            cout << "confined process_async threw: " << e.what() << endl;
+        }
+
+        // Nothing is built until the first call or warm().
+        Transport::Options lazy_opts;
+        lazy_opts.lazy = true;
+        Transport lazy("lazy1", lazy_opts);
+        cout << "lazy.is_open()=" << lazy.is_open() << " total_processed=" << lazy.total_processed() << endl;
+        cout << lazy.process("r") << endl;
+        Transport warmed("lazy2", lazy_opts);
+        cout << "warmed.warm()=" << warmed.warm() << endl;
+        Transport lazy_fail("fail", lazy_opts);
+        cout << "lazy_fail.is_open()=" << lazy_fail.is_open() << endl;
+        try {
+            lazy_fail.process("s");
+        } catch (const exception& e) {
+            cout << "lazy_fail.process threw: " << e.what() << endl;
+        }
+        cout << "lazy_fail.is_open()=" << lazy_fail.is_open() << " open_error()=" << lazy_fail.open_error() << endl;
+
+        // One replica per node; on a single-node host this is a plain handle.
+        Transport::Options numa_opts;
+        numa_opts.numa_replicas = true;
+        numa_opts.metrics = true;
+        Transport replicated("numa1", numa_opts);
+        cout << replicated.process("t") << endl;
+        cout << "numa nodes=" << Transport::numa_nodes() << " replicated.total_processed()=" << replicated.total_processed()
+             << " process calls=" << replicated.stats().process.calls << endl;
+    }
+
+    {
+        // The async sink writes from its own thread; flush() before printing
+        // anything else keeps the output in order.
+        AsyncLogSink async_log(console);
+        set_log_sink(&async_log);
+        TRANSPORT_LOG(info, "async sink, offset {} of {}", ptrdiff_t(-3), size_t(8));
+        async_log.flush();
+        set_log_sink(&console);
     }
 
     cout << "bottom of main" << endl;
+    set_log_sink(nullptr);
+#if TRANSPORT_TRACE
+    set_trace_sink(nullptr);
+    cout << "trace events dropped=" << trace.dropped() << endl;
+#endif
 }
\ No newline at end of file